@@ -0,0 +1,37 @@
+#!/bin/sh
+# Builds Debug, Profile and Release and compares startup and frame times.
+# usage: ./bench.sh [frames]
+FRAMES=${1:-2000}
+./shader.sh
+for config in Debug Profile Release; do
+	dir=build-$(echo $config | tr '[:upper:]' '[:lower:]')
+	cmake -S . -B $dir -DCMAKE_BUILD_TYPE=$config > /dev/null && cmake --build $dir -j > /dev/null || exit 1
+	./$dir/learn-vulkan --frames $FRAMES 2>&1 | grep "\[bench\]"
+done
+# time to first frame with and without the startup worker threads
+for mode in "" --serial-startup; do
+	./build-release/learn-vulkan --frames 1 $mode 2>&1 | grep "\[bench\].*startup mode="
+done
+# particle count against GPU simulation and draw time
+for count in 65536 262144 1048576 4194304; do
+	./build-release/learn-vulkan --frames 500 --particles $count 2>&1 | grep "\[bench\].*particles"
+done
+# sprite count against draws per frame and CPU sort/vertex time
+for count in 1000 10000 100000 1000000; do
+	./build-release/learn-vulkan --frames 500 --sprites $count 2>&1 | grep "\[bench\].*sprites"
+done
+# attachment memory with and without lazy allocation
+for samples in 1 4; do
+	for mode in "" --no-lazy; do
+		./build-release/learn-vulkan --frames 100 --msaa $samples $mode 2>&1 | grep "\[bench\].*attachments"
+	done
+done
+# simulation rate against skipped/repeated packets and late frames
+for hz in 30 60 240; do
+	./build-release/learn-vulkan --frames 500 --sprites 10000 --sim-hz $hz 2>&1 | grep "\[bench\].*scene"
+done
+# render scale on a big window, fixed and following a 16 ms GPU budget
+for mode in "--render-scale 1" "--render-scale 0.5" "--gpu-budget 16"; do
+	./build-release/learn-vulkan --frames 500 --window 3840x2160 --particles 1048576 $mode 2>&1 |
+		grep "\[bench\].*\(resolution\|frame_time\)"
+done
@@ -1,2 +1,6 @@
 glslc shaders/triangle.vert -o vert.spv
 glslc shaders/triangle.frag -o frag.spv
+glslc shaders/particles.comp -o particles_comp.spv
+glslc shaders/particles.vert -o particles_vert.spv
+glslc shaders/sprite.vert -o sprite_vert.spv
+glslc shaders/sprite.frag -o sprite_frag.spv
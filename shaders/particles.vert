@@ -0,0 +1,13 @@
+#version 450
+
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 velocity;
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+    gl_Position = vec4(position, 0.0, 1.0);
+    gl_PointSize = 1.0;
+    float speed = clamp(length(velocity) * 0.5, 0.0, 1.0);
+    fragColor = mix(vec3(0.1, 0.3, 1.0), vec3(1.0, 0.6, 0.1), speed);
+}
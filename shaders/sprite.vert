@@ -0,0 +1,19 @@
+#version 450
+
+layout(push_constant) uniform PushConstants {
+    vec2 scale;
+    vec2 offset;
+} pc;
+
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec4 color;
+
+layout(location = 0) out vec2 fragUv;
+layout(location = 1) out vec4 fragColor;
+
+void main() {
+    gl_Position = vec4(position * pc.scale + pc.offset, 0.0, 1.0);
+    fragUv = uv;
+    fragColor = color;
+}
@@ -0,0 +1,183 @@
+#include "attachments.h"
+
+#include <string.h>
+
+#include "clib/log.h"
+#include "host_memory.h"
+#include "vk_util.h"
+
+VkSampleCountFlagBits attachments_pick_samples(const VkPhysicalDeviceProperties *properties, uint32_t requested)
+{
+    VkSampleCountFlags supported =
+        properties->limits.framebufferColorSampleCounts & properties->limits.framebufferDepthSampleCounts;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    for (uint32_t count = VK_SAMPLE_COUNT_64_BIT; count > VK_SAMPLE_COUNT_1_BIT; count >>= 1)
+    {
+        if (count <= requested && (supported & count))
+        {
+            samples = (VkSampleCountFlagBits)count;
+            break;
+        }
+    }
+    if (samples != requested && requested > 1)
+    {
+        logw("%u samples not supported, using %u", requested, (uint32_t)samples);
+    }
+    return samples;
+}
+
+VkFormat attachments_pick_depth_format(VkPhysicalDevice physicalDevice)
+{
+    const VkFormat candidates[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT,
+                                   VK_FORMAT_D16_UNORM};
+    for (uint32_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++)
+    {
+        VkFormatProperties properties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, candidates[i], &properties);
+        if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT)
+            return candidates[i];
+    }
+    // D16_UNORM support is required, not reached on a conformant device
+    return VK_FORMAT_D16_UNORM;
+}
+
+static int create_attachment(struct Attachments *attachments, const VkPhysicalDeviceMemoryProperties *memory,
+                             VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, int lazy,
+                             struct Attachment *attachment)
+{
+    VkDevice device = attachments->device;
+    VkImageCreateInfo imageInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                   .imageType = VK_IMAGE_TYPE_2D,
+                                   .format = format,
+                                   .extent = {attachments->extent.width, attachments->extent.height, 1},
+                                   .mipLevels = 1,
+                                   .arrayLayers = 1,
+                                   .samples = attachments->samples,
+                                   .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                   .usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+                                   .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                                   .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+    if (vkCreateImage(device, &imageInfo, host_vk_allocator(), &attachment->image) != VK_SUCCESS)
+    {
+        loge("failed to create attachment image!");
+        attachment->image = VK_NULL_HANDLE;
+        return 0;
+    }
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device, attachment->image, &requirements);
+    uint32_t type = UINT32_MAX;
+    if (lazy)
+    {
+        type = find_memory_type(memory, requirements.memoryTypeBits,
+                                VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+    attachment->lazy = type != UINT32_MAX;
+    if (type == UINT32_MAX)
+    {
+        type = find_memory_type(memory, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+    }
+    if (type == UINT32_MAX)
+    {
+        loge("no memory type for attachment!");
+        return 0;
+    }
+    VkMemoryAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                      .allocationSize = requirements.size,
+                                      .memoryTypeIndex = type};
+    if (vkAllocateMemory(device, &allocInfo, host_vk_allocator(), &attachment->memory) != VK_SUCCESS)
+    {
+        loge("failed to allocate attachment memory!");
+        attachment->memory = VK_NULL_HANDLE;
+        return 0;
+    }
+    attachment->size = requirements.size;
+    vkBindImageMemory(device, attachment->image, attachment->memory, 0);
+
+    VkImageViewCreateInfo viewInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                                      .image = attachment->image,
+                                      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                                      .format = format,
+                                      .components = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+                                                     VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY},
+                                      .subresourceRange = {.aspectMask = aspect,
+                                                           .baseMipLevel = 0,
+                                                           .levelCount = 1,
+                                                           .baseArrayLayer = 0,
+                                                           .layerCount = 1}};
+    if (vkCreateImageView(device, &viewInfo, host_vk_allocator(), &attachment->view) != VK_SUCCESS)
+    {
+        loge("failed to create attachment view!");
+        attachment->view = VK_NULL_HANDLE;
+        return 0;
+    }
+    return 1;
+}
+
+int attachments_init(struct Attachments *attachments, VkDevice device, const VkPhysicalDeviceMemoryProperties *memory,
+                     VkExtent2D extent, VkFormat colorFormat, VkFormat depthFormat, VkSampleCountFlagBits samples,
+                     int lazy)
+{
+    memset(attachments, 0, sizeof(*attachments));
+    attachments->device = device;
+    attachments->extent = extent;
+    attachments->samples = samples;
+    attachments->depthFormat = depthFormat;
+    if (samples != VK_SAMPLE_COUNT_1_BIT &&
+        !create_attachment(attachments, memory, colorFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+                           VK_IMAGE_ASPECT_COLOR_BIT, lazy, &attachments->color))
+    {
+        attachments_destroy(attachments);
+        return 0;
+    }
+    if (!create_attachment(attachments, memory, depthFormat, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+                           VK_IMAGE_ASPECT_DEPTH_BIT, lazy, &attachments->depth))
+    {
+        attachments_destroy(attachments);
+        return 0;
+    }
+    logi("Attachments: %u samples, depth format %i, %s memory", (uint32_t)samples, depthFormat,
+         attachments->depth.lazy ? "lazily allocated" : "device local");
+    return 1;
+}
+
+// lazily allocated memory only commits what the GPU actually had to back
+static VkDeviceSize committed(VkDevice device, const struct Attachment *attachment)
+{
+    if (attachment->memory == VK_NULL_HANDLE)
+        return 0;
+    if (!attachment->lazy)
+        return attachment->size;
+    VkDeviceSize bytes = 0;
+    vkGetDeviceMemoryCommitment(device, attachment->memory, &bytes);
+    return bytes;
+}
+
+void attachments_report(const struct Attachments *attachments)
+{
+    VkDevice device = attachments->device;
+    VkDeviceSize allocated = attachments->color.size + attachments->depth.size;
+    VkDeviceSize colorCommitted = committed(device, &attachments->color);
+    VkDeviceSize depthCommitted = committed(device, &attachments->depth);
+    logi("[bench] config=%s attachments samples=%u lazy=%d allocated_kb=%llu committed_kb=%llu color_kb=%llu "
+         "depth_kb=%llu",
+         BUILD_CONFIG, (uint32_t)attachments->samples, attachments->depth.lazy,
+         (unsigned long long)(allocated / 1024), (unsigned long long)((colorCommitted + depthCommitted) / 1024),
+         (unsigned long long)(colorCommitted / 1024), (unsigned long long)(depthCommitted / 1024));
+}
+
+static void destroy_attachment(VkDevice device, struct Attachment *attachment)
+{
+    if (attachment->view != VK_NULL_HANDLE)
+        vkDestroyImageView(device, attachment->view, host_vk_allocator());
+    if (attachment->image != VK_NULL_HANDLE)
+        vkDestroyImage(device, attachment->image, host_vk_allocator());
+    if (attachment->memory != VK_NULL_HANDLE)
+        vkFreeMemory(device, attachment->memory, host_vk_allocator());
+    memset(attachment, 0, sizeof(*attachment));
+}
+
+void attachments_destroy(struct Attachments *attachments)
+{
+    destroy_attachment(attachments->device, &attachments->color);
+    destroy_attachment(attachments->device, &attachments->depth);
+}
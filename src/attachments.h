@@ -0,0 +1,45 @@
+#ifndef ATTACHMENTS_H
+#define ATTACHMENTS_H
+
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+struct Attachment
+{
+    VkImage image;
+    VkImageView view;
+    VkDeviceMemory memory;
+    VkDeviceSize size; // allocation size
+    int lazy;          // memory type is LAZILY_ALLOCATED
+};
+
+// The multisampled color and the depth attachment of the main render pass.
+// Both only live inside the render pass: color is resolved into the swapchain
+// image at the end of the subpass and neither is stored, so they are created
+// TRANSIENT and, where the device has such a memory type, backed by lazily
+// allocated memory that tile based GPUs never have to commit.
+struct Attachments
+{
+    VkDevice device;
+    VkExtent2D extent;
+    VkSampleCountFlagBits samples;
+    VkFormat depthFormat;
+    struct Attachment color; // VK_NULL_HANDLE without MSAA, the swapchain image is rendered to directly
+    struct Attachment depth;
+};
+
+// the highest supported sample count not above `requested`, for both color and depth
+VkSampleCountFlagBits attachments_pick_samples(const VkPhysicalDeviceProperties *properties, uint32_t requested);
+// first of D32, D32S8, D24S8, D16 usable as an optimal tiling depth attachment
+VkFormat attachments_pick_depth_format(VkPhysicalDevice physicalDevice);
+
+// `lazy` 0 always uses plain device local memory, to compare against
+int attachments_init(struct Attachments *attachments, VkDevice device, const VkPhysicalDeviceMemoryProperties *memory,
+                     VkExtent2D extent, VkFormat colorFormat, VkFormat depthFormat, VkSampleCountFlagBits samples,
+                     int lazy);
+// committed bytes as reported by vkGetDeviceMemoryCommitment, call after rendering
+void attachments_report(const struct Attachments *attachments);
+// device has to be idle
+void attachments_destroy(struct Attachments *attachments);
+
+#endif
@@ -0,0 +1,404 @@
+#include "capture.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "clib/log.h"
+#include "host_memory.h"
+#include "timing.h"
+#include "vk_util.h"
+
+#define PNG_BLOCK_MAX 65535 // biggest stored deflate block
+
+static uint32_t crcTable[256];
+static pthread_once_t crcOnce = PTHREAD_ONCE_INIT;
+
+static void init_crc_table(void)
+{
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        crcTable[n] = c;
+    }
+}
+
+static uint32_t crc_update(uint32_t crc, const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+        crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+static void put_be32(uint8_t *out, uint32_t v)
+{
+    out[0] = v >> 24;
+    out[1] = v >> 16;
+    out[2] = v >> 8;
+    out[3] = v;
+}
+
+static void png_chunk(FILE *file, const char *type, const uint8_t *data, uint32_t size)
+{
+    uint8_t header[8];
+    put_be32(header, size);
+    memcpy(header + 4, type, 4);
+    uint32_t crc = crc_update(0xffffffffu, header + 4, 4);
+    crc = crc_update(crc, data, size);
+    uint8_t footer[4];
+    put_be32(footer, crc ^ 0xffffffffu);
+    fwrite(header, 1, 8, file);
+    if (size)
+        fwrite(data, 1, size, file);
+    fwrite(footer, 1, 4, file);
+}
+
+// Uncompressed PNG: scanlines go into stored deflate blocks, one IDAT each.
+// Bigger files than zlib would give, but the worker keeps up with every frame.
+struct PngStream
+{
+    FILE *file;
+    uint32_t adlerA;
+    uint32_t adlerB;
+    uint32_t used;
+    uint8_t block[5 + PNG_BLOCK_MAX];
+};
+
+static void png_flush_block(struct PngStream *png, int last)
+{
+    uint8_t *header = png->block;
+    header[0] = last ? 1 : 0;
+    header[1] = png->used & 0xff;
+    header[2] = png->used >> 8;
+    header[3] = ~png->used & 0xff;
+    header[4] = (~png->used >> 8) & 0xff;
+    png_chunk(png->file, "IDAT", png->block, 5 + png->used);
+    png->used = 0;
+}
+
+static void png_write(struct PngStream *png, const uint8_t *data, size_t size)
+{
+    // adler32, 5552 bytes is the most that can be summed before the modulo overflows
+    for (size_t i = 0; i < size;)
+    {
+        size_t end = size - i > 5552 ? i + 5552 : size;
+        for (; i < end; i++)
+        {
+            png->adlerA += data[i];
+            png->adlerB += png->adlerA;
+        }
+        png->adlerA %= 65521;
+        png->adlerB %= 65521;
+    }
+    while (size)
+    {
+        if (png->used == PNG_BLOCK_MAX)
+            png_flush_block(png, 0);
+        size_t n = PNG_BLOCK_MAX - png->used;
+        if (n > size)
+            n = size;
+        memcpy(png->block + 5 + png->used, data, n);
+        png->used += n;
+        data += n;
+        size -= n;
+    }
+}
+
+static int write_png(const char *path, const uint8_t *pixels, uint32_t width, uint32_t height, int swizzle)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return 0;
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    fwrite(signature, 1, 8, file);
+    uint8_t ihdr[13];
+    put_be32(ihdr, width);
+    put_be32(ihdr + 4, height);
+    ihdr[8] = 8;  // bit depth
+    ihdr[9] = 6;  // RGBA
+    ihdr[10] = 0; // deflate
+    ihdr[11] = 0; // adaptive filtering
+    ihdr[12] = 0; // no interlace
+    png_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+
+    static const uint8_t zlibHeader[2] = {0x78, 0x01};
+    png_chunk(file, "IDAT", zlibHeader, 2);
+
+    struct PngStream png = {.file = file, .adlerA = 1, .adlerB = 0, .used = 0};
+    uint8_t row[1 + 4 * 1024];
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const uint8_t *src = pixels + (size_t)y * width * 4;
+        uint8_t filter = 0;
+        png_write(&png, &filter, 1);
+        // swizzle through a small buffer instead of a copy of the whole image
+        for (uint32_t x = 0; x < width; x += 1024)
+        {
+            uint32_t n = width - x < 1024 ? width - x : 1024;
+            const uint8_t *s = src + (size_t)x * 4;
+            for (uint32_t i = 0; i < n; i++)
+            {
+                row[i * 4 + 0] = swizzle ? s[i * 4 + 2] : s[i * 4 + 0];
+                row[i * 4 + 1] = s[i * 4 + 1];
+                row[i * 4 + 2] = swizzle ? s[i * 4 + 0] : s[i * 4 + 2];
+                row[i * 4 + 3] = 0xff; // swapchain alpha is meaningless with opaque composite
+            }
+            png_write(&png, row, (size_t)n * 4);
+        }
+    }
+    png_flush_block(&png, 1);
+    uint8_t adler[4];
+    put_be32(adler, (png.adlerB << 16) | png.adlerA);
+    png_chunk(file, "IDAT", adler, 4);
+    png_chunk(file, "IEND", NULL, 0);
+    int ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
+
+static int write_frame(struct Capture *capture, const struct CaptureSlot *slot)
+{
+    char path[512];
+    if (capture->fileFormat == CAPTURE_PNG)
+    {
+        snprintf(path, sizeof(path), "%s/frame_%06llu.png", capture->directory, (unsigned long long)slot->frame);
+        return write_png(path, slot->mapped, capture->extent.width, capture->extent.height, capture->swizzle);
+    }
+    snprintf(path, sizeof(path), "%s/frame_%06llu.raw", capture->directory, (unsigned long long)slot->frame);
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return 0;
+    size_t written = fwrite(slot->mapped, 1, capture->frameSize, file);
+    fclose(file);
+    return written == capture->frameSize;
+}
+
+static void *capture_worker(void *arg)
+{
+    struct Capture *capture = arg;
+    pthread_mutex_lock(&capture->lock);
+    for (;;)
+    {
+        struct CaptureSlot *slot = NULL;
+        for (uint32_t i = 0; i < CAPTURE_RING_SIZE; i++)
+        {
+            struct CaptureSlot *s = &capture->slots[i];
+            if (s->state == CAPTURE_SLOT_QUEUED && (!slot || s->frame < slot->frame))
+                slot = s;
+        }
+        if (!slot)
+        {
+            if (capture->quit)
+                break;
+            pthread_cond_wait(&capture->wake, &capture->lock);
+            continue;
+        }
+        slot->state = CAPTURE_SLOT_WRITING;
+        pthread_mutex_unlock(&capture->lock);
+
+        double start = time_ms();
+        int ok = write_frame(capture, slot);
+        double ms = time_ms() - start;
+        if (!ok)
+            loge("Could not write capture of frame %llu", (unsigned long long)slot->frame);
+
+        pthread_mutex_lock(&capture->lock);
+        slot->state = CAPTURE_SLOT_FREE;
+        capture->written += ok ? 1 : 0;
+        capture->writeMs += ms;
+    }
+    pthread_mutex_unlock(&capture->lock);
+    return NULL;
+}
+
+int capture_init(struct Capture *capture, VkDevice device, const VkPhysicalDeviceMemoryProperties *memory,
+                 VkExtent2D extent, VkFormat format, uint32_t interval, const char *directory,
+                 enum CaptureFormat fileFormat)
+{
+    memset(capture, 0, sizeof(*capture));
+    if (interval == 0)
+        return 1;
+
+    switch (format)
+    {
+    case VK_FORMAT_B8G8R8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+        capture->swizzle = 1;
+        break;
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_R8G8B8A8_UNORM:
+        capture->swizzle = 0;
+        break;
+    default:
+        loge("Capture does not support swapchain format %i", format);
+        return 0;
+    }
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST)
+    {
+        loge("Could not create capture directory %s", directory);
+        return 0;
+    }
+
+    capture->device = device;
+    capture->extent = extent;
+    capture->format = format;
+    capture->frameSize = (VkDeviceSize)extent.width * extent.height * 4;
+    capture->interval = interval;
+    capture->directory = directory;
+    capture->fileFormat = fileFormat;
+    pthread_once(&crcOnce, init_crc_table);
+
+    for (uint32_t i = 0; i < CAPTURE_RING_SIZE; i++)
+    {
+        struct CaptureSlot *slot = &capture->slots[i];
+        VkMemoryPropertyFlags flags;
+        // cached memory makes the cpu side reads fast, coherency is optional
+        if (!create_buffer(device, memory, capture->frameSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_CACHED_BIT, &slot->buffer,
+                           &slot->memory, &flags))
+        {
+            for (uint32_t j = 0; j < i; j++)
+            {
+                vkUnmapMemory(device, capture->slots[j].memory);
+                destroy_buffer(device, capture->slots[j].buffer, capture->slots[j].memory);
+            }
+            capture->interval = 0;
+            return 0;
+        }
+        capture->coherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+        vkMapMemory(device, slot->memory, 0, VK_WHOLE_SIZE, 0, &slot->mapped);
+        slot->state = CAPTURE_SLOT_FREE;
+    }
+
+    pthread_mutex_init(&capture->lock, NULL);
+    pthread_cond_init(&capture->wake, NULL);
+    pthread_create(&capture->worker, NULL, capture_worker, capture);
+    logi("Capturing every %u frame(s) to %s as %s", interval, directory, fileFormat == CAPTURE_PNG ? "png" : "raw");
+    return 1;
+}
+
+void capture_record(struct Capture *capture, VkCommandBuffer buffer, VkImage image, uint64_t frame)
+{
+    if (capture->interval == 0 || frame % capture->interval != 0)
+        return;
+
+    struct CaptureSlot *slot = NULL;
+    pthread_mutex_lock(&capture->lock);
+    for (uint32_t i = 0; i < CAPTURE_RING_SIZE && !slot; i++)
+    {
+        if (capture->slots[i].state == CAPTURE_SLOT_FREE)
+            slot = &capture->slots[i];
+    }
+    if (slot)
+    {
+        slot->state = CAPTURE_SLOT_IN_FLIGHT;
+        slot->frame = frame;
+        capture->captured++;
+    }
+    else
+    {
+        capture->dropped++;
+    }
+    pthread_mutex_unlock(&capture->lock);
+    if (!slot)
+        return;
+
+    VkImageSubresourceRange range = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                     .baseMipLevel = 0,
+                                     .levelCount = 1,
+                                     .baseArrayLayer = 0,
+                                     .layerCount = 1};
+    VkImageMemoryBarrier toTransfer = {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                       .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+                                       .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+                                       .oldLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                       .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                       .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                       .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                       .image = image,
+                                       .subresourceRange = range};
+    vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0,
+                         NULL, 0, NULL, 1, &toTransfer);
+
+    VkBufferImageCopy region = {.bufferOffset = 0,
+                                .bufferRowLength = 0,
+                                .bufferImageHeight = 0,
+                                .imageSubresource = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                                     .mipLevel = 0,
+                                                     .baseArrayLayer = 0,
+                                                     .layerCount = 1},
+                                .imageOffset = {0, 0, 0},
+                                .imageExtent = {capture->extent.width, capture->extent.height, 1}};
+    vkCmdCopyImageToBuffer(buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffer, 1, &region);
+
+    VkImageMemoryBarrier toPresent = toTransfer;
+    toPresent.srcAccessMask = 0;
+    toPresent.dstAccessMask = 0;
+    toPresent.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toPresent.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    VkBufferMemoryBarrier toHost = {.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                                    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                    .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+                                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                    .buffer = slot->buffer,
+                                    .offset = 0,
+                                    .size = VK_WHOLE_SIZE};
+    vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 1, &toHost, 1,
+                         &toPresent);
+}
+
+void capture_frames_complete(struct Capture *capture, uint64_t frame)
+{
+    if (capture->interval == 0)
+        return;
+    int queued = 0;
+    pthread_mutex_lock(&capture->lock);
+    for (uint32_t i = 0; i < CAPTURE_RING_SIZE; i++)
+    {
+        struct CaptureSlot *slot = &capture->slots[i];
+        if (slot->state != CAPTURE_SLOT_IN_FLIGHT || slot->frame > frame)
+            continue;
+        if (!capture->coherent)
+        {
+            VkMappedMemoryRange range = {.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+                                         .memory = slot->memory,
+                                         .offset = 0,
+                                         .size = VK_WHOLE_SIZE};
+            vkInvalidateMappedMemoryRanges(capture->device, 1, &range);
+        }
+        slot->state = CAPTURE_SLOT_QUEUED;
+        queued = 1;
+    }
+    if (queued)
+        pthread_cond_signal(&capture->wake);
+    pthread_mutex_unlock(&capture->lock);
+}
+
+void capture_destroy(struct Capture *capture)
+{
+    if (capture->interval == 0)
+        return;
+    pthread_mutex_lock(&capture->lock);
+    capture->quit = 1;
+    pthread_cond_signal(&capture->wake);
+    pthread_mutex_unlock(&capture->lock);
+    pthread_join(capture->worker, NULL);
+
+    logi("[bench] capture captured=%llu written=%llu dropped=%llu avg_write_ms=%.3f",
+         (unsigned long long)capture->captured, (unsigned long long)capture->written,
+         (unsigned long long)capture->dropped, capture->written ? capture->writeMs / (double)capture->written : 0.0);
+
+    for (uint32_t i = 0; i < CAPTURE_RING_SIZE; i++)
+    {
+        vkUnmapMemory(capture->device, capture->slots[i].memory);
+        destroy_buffer(capture->device, capture->slots[i].buffer, capture->slots[i].memory);
+    }
+    pthread_cond_destroy(&capture->wake);
+    pthread_mutex_destroy(&capture->lock);
+    capture->interval = 0;
+}
@@ -0,0 +1,72 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+#define CAPTURE_RING_SIZE 3
+
+enum CaptureFormat
+{
+    CAPTURE_PNG,
+    CAPTURE_RAW, // pixels exactly as copied out of the image, in its VkFormat
+};
+
+enum CaptureSlotState
+{
+    CAPTURE_SLOT_FREE,
+    CAPTURE_SLOT_IN_FLIGHT, // copy recorded, frame fence not signaled yet
+    CAPTURE_SLOT_QUEUED,    // copy finished, waiting for the worker
+    CAPTURE_SLOT_WRITING,
+};
+
+struct CaptureSlot
+{
+    VkBuffer buffer;
+    VkDeviceMemory memory;
+    void *mapped; // persistently mapped
+    uint64_t frame;
+    enum CaptureSlotState state;
+};
+
+// Reads frames back into a ring of host visible buffers and writes them out on
+// a worker thread. A frame is only read after its fence signaled and if every
+// slot is still busy the frame is dropped, so capturing never stalls the GPU.
+struct Capture
+{
+    VkDevice device;
+    VkExtent2D extent;
+    VkFormat format;
+    VkDeviceSize frameSize;
+    int coherent;
+    int swizzle; // BGRA -> RGBA for png
+    uint32_t interval; // capture every interval-th frame, 0 = disabled
+    enum CaptureFormat fileFormat;
+    const char *directory;
+    struct CaptureSlot slots[CAPTURE_RING_SIZE];
+
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int quit;
+
+    uint64_t captured;
+    uint64_t dropped;
+    uint64_t written;
+    double writeMs;
+};
+
+// interval 0 leaves capture disabled, every other call is then a no-op
+int capture_init(struct Capture *capture, VkDevice device, const VkPhysicalDeviceMemoryProperties *memory,
+                 VkExtent2D extent, VkFormat format, uint32_t interval, const char *directory,
+                 enum CaptureFormat fileFormat);
+// records the copy of `image` if `frame` is due. The image has to be in
+// VK_IMAGE_LAYOUT_PRESENT_SRC_KHR and is left in it.
+void capture_record(struct Capture *capture, VkCommandBuffer buffer, VkImage image, uint64_t frame);
+// every frame up to and including `frame` has finished on the GPU
+void capture_frames_complete(struct Capture *capture, uint64_t frame);
+// device has to be idle, waits for the worker to write out everything queued
+void capture_destroy(struct Capture *capture);
+
+#endif
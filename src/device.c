@@ -0,0 +1,363 @@
+#include "device.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clib/log.h"
+
+#define DEVICE_CACHE_MAGIC 0x4c564443u // "LVDC"
+#define DEVICE_CACHE_VERSION 2u
+
+static const char *requiredExtensions[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+static const uint32_t requiredExtensions_count = sizeof(requiredExtensions) / sizeof(requiredExtensions[0]);
+static const VkPhysicalDeviceFeatures requiredFeatures = {0};
+
+struct DeviceCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerVersion; // VK_HEADER_VERSION, struct layouts can change with it
+    uint32_t entrySize;
+    uint32_t count;
+};
+
+struct QueueFamilyIndices get_queue_family(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
+{
+
+    uint32_t queueFamilyCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
+    VkQueueFamilyProperties queueProps[queueFamilyCount];
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueProps);
+    struct QueueFamilyIndices fam = {
+        .presentation_present = 0, .compute_present = 0, .graphics_present = 0, .raytrace_present = 0};
+    for (uint32_t i = 0; i < queueFamilyCount; i++)
+    {
+        if (queueProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
+        {
+            fam.graphics_present = 1;
+            fam.graphics = i;
+        }
+        else if (queueProps[i].queueFlags & VK_QUEUE_COMPUTE_BIT)
+        {
+            fam.compute_present = 1;
+            fam.compute = i;
+        }
+        VkBool32 presentSupport = 0;
+        if (surface != VK_NULL_HANDLE)
+            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
+        if (presentSupport)
+        {
+            fam.presentation_present = 1;
+            fam.presentation = i;
+        }
+    }
+    return fam;
+}
+
+static void load_device_cache(struct DeviceCache *cache)
+{
+    cache->count = 0;
+    cache->dirty = 0;
+    FILE *file = fopen(DEVICE_CACHE_FILE, "rb");
+    if (!file)
+    {
+        return;
+    }
+    struct DeviceCacheHeader header;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == DEVICE_CACHE_MAGIC &&
+        header.version == DEVICE_CACHE_VERSION && header.headerVersion == VK_HEADER_VERSION &&
+        header.entrySize == sizeof(struct DeviceInfo) && header.count <= DEVICE_MAX)
+    {
+        if (fread(cache->entries, sizeof(struct DeviceInfo), header.count, file) == header.count)
+        {
+            cache->count = header.count;
+        }
+    }
+    if (cache->count == 0)
+    {
+        logw("Ignoring stale or corrupt %s", DEVICE_CACHE_FILE);
+    }
+    fclose(file);
+}
+
+void save_device_cache(struct DeviceCache *cache)
+{
+    if (!cache->dirty)
+    {
+        return;
+    }
+    cache->dirty = 0;
+    FILE *file = fopen(DEVICE_CACHE_FILE, "wb");
+    if (!file)
+    {
+        logw("Could not write %s", DEVICE_CACHE_FILE);
+        return;
+    }
+    struct DeviceCacheHeader header = {.magic = DEVICE_CACHE_MAGIC,
+                                       .version = DEVICE_CACHE_VERSION,
+                                       .headerVersion = VK_HEADER_VERSION,
+                                       .entrySize = sizeof(struct DeviceInfo),
+                                       .count = cache->count};
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(cache->entries, sizeof(struct DeviceInfo), cache->count, file);
+    fclose(file);
+}
+
+static int same_device(const VkPhysicalDeviceProperties *a, const VkPhysicalDeviceProperties *b)
+{
+    return a->vendorID == b->vendorID && a->deviceID == b->deviceID && a->driverVersion == b->driverVersion &&
+           memcmp(a->pipelineCacheUUID, b->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+static int has_required_extensions(VkPhysicalDevice physicalDevice)
+{
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, NULL);
+    VkExtensionProperties extensions[extensionCount];
+    vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionCount, extensions);
+    for (uint32_t r = 0; r < requiredExtensions_count; r++)
+    {
+        int found = 0;
+        for (uint32_t i = 0; i < extensionCount && !found; i++)
+        {
+            found = strcmp(requiredExtensions[r], extensions[i].extensionName) == 0;
+        }
+        if (!found)
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int has_required_features(const VkPhysicalDeviceFeatures *features)
+{
+    // VkPhysicalDeviceFeatures is nothing but VkBool32s
+    const VkBool32 *have = (const VkBool32 *)features;
+    const VkBool32 *want = (const VkBool32 *)&requiredFeatures;
+    for (size_t i = 0; i < sizeof(VkPhysicalDeviceFeatures) / sizeof(VkBool32); i++)
+    {
+        if (want[i] && !have[i])
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// the part of DeviceInfo that only depends on the device and driver, this is what gets cached
+static void query_device_info(VkPhysicalDevice physicalDevice, struct DeviceInfo *info)
+{
+    vkGetPhysicalDeviceFeatures(physicalDevice, &info->features);
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &info->memory);
+    info->queues = get_queue_family(physicalDevice, VK_NULL_HANDLE);
+    info->hasRequiredExtensions = has_required_extensions(physicalDevice);
+}
+
+// presentation queue, formats and present modes belong to the surface, which
+// can differ from run to run (other compositor, monitor, session), so they are
+// never taken from the cache
+static void query_surface_info(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, struct DeviceInfo *info)
+{
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
+    info->queues.presentation_present = 0;
+    for (uint32_t i = 0; i < queueFamilyCount; i++)
+    {
+        VkBool32 presentSupport = 0;
+        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
+        if (presentSupport)
+        {
+            info->queues.presentation_present = 1;
+            info->queues.presentation = i;
+        }
+    }
+
+    info->formats_count = DEVICE_MAX_SURFACE_FORMATS;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physicalDevice, surface, &info->formats_count, info->formats);
+    info->presentModes_count = DEVICE_MAX_PRESENT_MODES;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &info->presentModes_count,
+                                              info->presentModes);
+}
+
+static int64_t score_device(const struct DeviceInfo *info)
+{
+    if (!info->queues.graphics_present || !info->queues.presentation_present || !info->hasRequiredExtensions ||
+        !has_required_features(&info->features) || info->formats_count == 0 || info->presentModes_count == 0)
+    {
+        return -1;
+    }
+
+    int64_t score = 0;
+    switch (info->properties.deviceType)
+    {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+        score += 4000;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+        score += 3000;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+        score += 2000;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:
+        score += 1000;
+        break;
+    default:
+        break;
+    }
+
+    // one queue for graphics and present saves the concurrent sharing mode
+    if (info->queues.graphics == info->queues.presentation)
+        score += 100;
+    if (info->queues.compute_present)
+        score += 50;
+
+    // biggest device local heap, 1 point per 32MiB, never enough to beat a better device type
+    VkDeviceSize largestHeap = 0;
+    for (uint32_t i = 0; i < info->memory.memoryHeapCount; i++)
+    {
+        if ((info->memory.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) &&
+            info->memory.memoryHeaps[i].size > largestHeap)
+        {
+            largestHeap = info->memory.memoryHeaps[i].size;
+        }
+    }
+    VkDeviceSize heapScore = largestHeap / (32 * 1024 * 1024);
+    score += heapScore > 500 ? 500 : (int64_t)heapScore;
+
+    // optional features
+    if (info->features.textureCompressionBC)
+        score += 20;
+    if (info->features.samplerAnisotropy)
+        score += 10;
+    return score;
+}
+
+static int matches_override(const char *override, uint32_t index, const char *deviceName)
+{
+    char *end = NULL;
+    unsigned long asIndex = strtoul(override, &end, 10);
+    if (end != override && *end == '\0')
+    {
+        return asIndex == index;
+    }
+    // case insensitive substring of the device name
+    size_t n = strlen(override);
+    for (const char *p = deviceName; *p; p++)
+    {
+        size_t i = 0;
+        while (i < n && p[i] && tolower((unsigned char)p[i]) == tolower((unsigned char)override[i]))
+            i++;
+        if (i == n)
+            return 1;
+    }
+    return 0;
+}
+
+void enumerate_physical_devices(VkInstance instance, struct PhysicalDevices *devices)
+{
+    devices->count = DEVICE_MAX;
+    VkResult result = vkEnumeratePhysicalDevices(instance, &devices->count, devices->devices);
+    if (result == VK_INCOMPLETE)
+    {
+        logw("More than %u devices, ignoring the rest", DEVICE_MAX);
+    }
+    logi("%i devices found", devices->count);
+    for (uint32_t i = 0; i < devices->count; i++)
+    {
+        vkGetPhysicalDeviceProperties(devices->devices[i], &devices->properties[i]);
+    }
+    load_device_cache(&devices->cache);
+}
+
+VkPhysicalDevice pick_physical_device(struct PhysicalDevices *devices, VkSurfaceKHR surface, const char *override,
+                                      struct DeviceInfo *info)
+{
+    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+    uint32_t deviceCount = devices->count;
+    if (deviceCount == 0)
+    {
+        loge("No vulkan devices found");
+        exit(1);
+    }
+
+    if (override == NULL)
+    {
+        override = getenv("LEARN_VULKAN_DEVICE");
+    }
+
+    struct DeviceCache *cache = &devices->cache;
+    struct DeviceInfo *infos = malloc(sizeof(struct DeviceInfo) * deviceCount);
+    int best = -1;
+    int forced = -1;
+    for (uint32_t i = 0; i < deviceCount; i++)
+    {
+        struct DeviceInfo *current = &infos[i];
+        const VkPhysicalDeviceProperties *properties = &devices->properties[i];
+
+        int cached = 0;
+        for (uint32_t c = 0; c < cache->count && !cached; c++)
+        {
+            if (same_device(&cache->entries[c].properties, properties))
+            {
+                *current = cache->entries[c];
+                cached = 1;
+            }
+        }
+        if (!cached)
+        {
+            memset(current, 0, sizeof(*current));
+            current->properties = *properties;
+            query_device_info(devices->devices[i], current);
+            if (cache->count < DEVICE_MAX)
+            {
+                cache->entries[cache->count++] = *current;
+                cache->dirty = 1;
+            }
+        }
+        query_surface_info(devices->devices[i], surface, current);
+        current->score = score_device(current);
+        logi("[%u] %s | type %i | score %lli%s", i, current->properties.deviceName, current->properties.deviceType,
+             (long long)current->score, cached ? " (cached)" : "");
+
+        if (current->score >= 0 && (best < 0 || current->score > infos[best].score))
+        {
+            best = i;
+        }
+        if (override && forced < 0 && matches_override(override, i, current->properties.deviceName))
+        {
+            forced = i;
+        }
+    }
+    if (override)
+    {
+        if (forced < 0)
+        {
+            logw("No device matches override \"%s\", falling back to scoring", override);
+        }
+        else if (infos[forced].score < 0)
+        {
+            logw("Device %s is not usable, falling back to scoring", infos[forced].properties.deviceName);
+        }
+        else
+        {
+            best = forced;
+        }
+    }
+    if (best < 0)
+    {
+        loge("No usable vulkan device found");
+        exit(1);
+    }
+
+    physicalDevice = devices->devices[best];
+    *info = infos[best];
+    info->swapchainFamilies[0] = info->queues.graphics;
+    info->swapchainFamilies[1] = info->queues.presentation;
+    free(infos);
+    logi("Picked device: %s | %u", info->properties.deviceName, info->properties.vendorID);
+    return physicalDevice;
+}
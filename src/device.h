@@ -0,0 +1,76 @@
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+#define DEVICE_MAX_SURFACE_FORMATS 64
+#define DEVICE_MAX_PRESENT_MODES 16
+#define DEVICE_CACHE_FILE "device_cache.bin"
+#define DEVICE_MAX 16
+
+struct QueueFamilyIndices
+{
+    int graphics_present;
+    int presentation_present;
+    int compute_present;
+    int raytrace_present;
+    uint32_t graphics;
+    uint32_t compute;
+    uint32_t raytrace;
+    uint32_t presentation;
+};
+
+// everything we need to know about a physical device to score it and build a
+// swapchain on it. Plain data so it can be written to the device cache as is,
+// the surface dependent fields are left empty in the cache.
+struct DeviceInfo
+{
+    VkPhysicalDeviceProperties properties;
+    VkPhysicalDeviceFeatures features;
+    VkPhysicalDeviceMemoryProperties memory;
+    struct QueueFamilyIndices queues;
+    uint32_t swapchainFamilies[2]; // graphics, presentation; for concurrent sharing
+    int hasRequiredExtensions;
+    uint32_t formats_count;
+    VkSurfaceFormatKHR formats[DEVICE_MAX_SURFACE_FORMATS];
+    uint32_t presentModes_count;
+    VkPresentModeKHR presentModes[DEVICE_MAX_PRESENT_MODES];
+    int64_t score; // < 0 means unusable
+};
+
+struct DeviceCache
+{
+    uint32_t count;
+    struct DeviceInfo entries[DEVICE_MAX];
+    int dirty;
+};
+
+// what can be known about the devices before there is a surface
+struct PhysicalDevices
+{
+    uint32_t count;
+    VkPhysicalDevice devices[DEVICE_MAX];
+    VkPhysicalDeviceProperties properties[DEVICE_MAX];
+    struct DeviceCache cache;
+};
+
+// without a surface (VK_NULL_HANDLE) no presentation queue is looked for
+struct QueueFamilyIndices get_queue_family(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface);
+
+// enumerates the devices and loads DEVICE_CACHE_FILE, needs no surface so it
+// can run while the window is being created
+void enumerate_physical_devices(VkInstance instance, struct PhysicalDevices *devices);
+
+// Scores every device and returns the best one. `override` (device index or a
+// substring of the device name) forces a choice, NULL falls back to the
+// LEARN_VULKAN_DEVICE environment variable. Properties, features, extensions
+// and queue families are cached in DEVICE_CACHE_FILE keyed on device/driver
+// version, presentation support and surface formats are always queried.
+VkPhysicalDevice pick_physical_device(struct PhysicalDevices *devices, VkSurfaceKHR surface, const char *override,
+                                      struct DeviceInfo *info);
+
+// writes the cache back if pick_physical_device queried new devices
+void save_device_cache(struct DeviceCache *cache);
+
+#endif
@@ -0,0 +1,335 @@
+#include "host_memory.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clib/log.h"
+
+#define SCOPE_COUNT (VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1)
+#define POOL_CLASS_COUNT 3
+#define POOL_CLASS_NONE 0xffff
+
+static const size_t poolClassSizes[POOL_CLASS_COUNT] = {64, 256, 1024};
+static const char *scopeNames[SCOPE_COUNT] = {"command", "object", "cache", "device", "instance"};
+
+// sits right in front of every pointer handed to the driver
+struct AllocHeader
+{
+    size_t size;
+    uint32_t offset; // from the start of the raw block
+    uint16_t scope;
+    uint16_t poolClass;
+};
+_Static_assert(sizeof(struct AllocHeader) == 16, "allocation header must keep 16 byte alignment");
+
+struct ScopeStats
+{
+    atomic_uint_fast64_t allocations;
+    atomic_uint_fast64_t reallocations;
+    atomic_uint_fast64_t frees;
+    atomic_int_fast64_t bytes;
+    atomic_int_fast64_t peakBytes;
+    atomic_int_fast64_t internalBytes; // driver allocations reported via pfnInternalAllocation
+};
+
+static struct
+{
+    struct HostPool pools[POOL_CLASS_COUNT];
+    struct ScopeStats scopes[SCOPE_COUNT];
+    atomic_uint_fast64_t allocationCount;
+    int initialized;
+} host;
+
+static size_t align_up(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void arena_init(struct HostArena *arena, const char *name, size_t size)
+{
+    arena->name = name;
+    arena->base = malloc(size);
+    arena->size = size;
+    arena->used = 0;
+    arena->peak = 0;
+    arena->allocations = 0;
+    if (!arena->base)
+    {
+        loge("Could not reserve %zu bytes for arena %s", size, name);
+        exit(1);
+    }
+}
+
+void *arena_alloc(struct HostArena *arena, size_t size, size_t alignment)
+{
+    size_t start = align_up(arena->used, alignment);
+    if (start + size > arena->size)
+    {
+        loge("Arena %s out of memory: %zu + %zu > %zu bytes", arena->name, start, size, arena->size);
+        exit(1);
+    }
+    arena->used = start + size;
+    if (arena->used > arena->peak)
+        arena->peak = arena->used;
+    arena->allocations++;
+    return arena->base + start;
+}
+
+void arena_reset(struct HostArena *arena)
+{
+    arena->used = 0;
+}
+
+void arena_destroy(struct HostArena *arena)
+{
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+}
+
+void arena_report(const struct HostArena *arena)
+{
+    logi("[bench] host_memory arena=%s size=%zu peak=%zu allocs=%llu", arena->name, arena->size, arena->peak,
+         (unsigned long long)arena->allocations);
+}
+
+void pool_init(struct HostPool *pool, const char *name, size_t blockSize, size_t blocksPerChunk)
+{
+    pool->name = name;
+    pool->blockSize = align_up(blockSize < sizeof(void *) ? sizeof(void *) : blockSize, 16);
+    pool->blocksPerChunk = blocksPerChunk;
+    pool->freeList = NULL;
+    pool->chunks = NULL;
+    pool->chunks_count = 0;
+    pool->chunks_capacity = 0;
+    pool->blocksInUse = 0;
+    pool->peakBlocksInUse = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+}
+
+static int pool_grow(struct HostPool *pool)
+{
+    if (pool->chunks_count == pool->chunks_capacity)
+    {
+        uint32_t capacity = pool->chunks_capacity ? pool->chunks_capacity * 2 : 8;
+        void **chunks = realloc(pool->chunks, sizeof(void *) * capacity);
+        if (!chunks)
+            return 0;
+        pool->chunks = chunks;
+        pool->chunks_capacity = capacity;
+    }
+    uint8_t *chunk = malloc(pool->blockSize * pool->blocksPerChunk);
+    if (!chunk)
+        return 0;
+    pool->chunks[pool->chunks_count++] = chunk;
+    for (size_t i = 0; i < pool->blocksPerChunk; i++)
+    {
+        void *block = chunk + i * pool->blockSize;
+        *(void **)block = pool->freeList;
+        pool->freeList = block;
+    }
+    return 1;
+}
+
+void *pool_alloc(struct HostPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    void *block = NULL;
+    if (pool->freeList || pool_grow(pool))
+    {
+        block = pool->freeList;
+        pool->freeList = *(void **)block;
+        pool->blocksInUse++;
+        if (pool->blocksInUse > pool->peakBlocksInUse)
+            pool->peakBlocksInUse = pool->blocksInUse;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return block;
+}
+
+void pool_free(struct HostPool *pool, void *ptr)
+{
+    pthread_mutex_lock(&pool->lock);
+    *(void **)ptr = pool->freeList;
+    pool->freeList = ptr;
+    pool->blocksInUse--;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(struct HostPool *pool)
+{
+    for (uint32_t i = 0; i < pool->chunks_count; i++)
+        free(pool->chunks[i]);
+    free(pool->chunks);
+    pool->chunks = NULL;
+    pool->chunks_count = 0;
+    pool->chunks_capacity = 0;
+    pool->freeList = NULL;
+    pthread_mutex_destroy(&pool->lock);
+}
+
+static void scope_add_bytes(struct ScopeStats *stats, int64_t bytes)
+{
+    int_fast64_t now = atomic_fetch_add(&stats->bytes, bytes) + bytes;
+    int_fast64_t peak = atomic_load(&stats->peakBytes);
+    while (now > peak && !atomic_compare_exchange_weak(&stats->peakBytes, &peak, now))
+    {
+    }
+}
+
+static void *VKAPI_PTR vk_allocation(void *pUserData, size_t size, size_t alignment,
+                                     VkSystemAllocationScope allocationScope)
+{
+    (void)pUserData;
+    if (size == 0)
+        return NULL;
+    if (alignment < sizeof(struct AllocHeader))
+        alignment = sizeof(struct AllocHeader);
+    size_t total = size + sizeof(struct AllocHeader) + alignment;
+
+    // command scope only lives for the duration of a call, the pools are
+    // for everything that outlives it
+    uint16_t poolClass = POOL_CLASS_NONE;
+    if (allocationScope != VK_SYSTEM_ALLOCATION_SCOPE_COMMAND)
+    {
+        for (uint16_t i = 0; i < POOL_CLASS_COUNT && poolClass == POOL_CLASS_NONE; i++)
+        {
+            if (total <= poolClassSizes[i])
+                poolClass = i;
+        }
+    }
+    uint8_t *raw = poolClass == POOL_CLASS_NONE ? malloc(total) : pool_alloc(&host.pools[poolClass]);
+    if (!raw)
+        return NULL;
+
+    uint8_t *ptr = (uint8_t *)align_up((size_t)(raw + sizeof(struct AllocHeader)), alignment);
+    struct AllocHeader *header = (struct AllocHeader *)(ptr - sizeof(struct AllocHeader));
+    header->size = size;
+    header->offset = (uint32_t)(ptr - raw);
+    header->scope = (uint16_t)allocationScope;
+    header->poolClass = poolClass;
+
+    struct ScopeStats *stats = &host.scopes[allocationScope];
+    atomic_fetch_add(&stats->allocations, 1);
+    atomic_fetch_add(&host.allocationCount, 1);
+    scope_add_bytes(stats, (int64_t)size);
+    return ptr;
+}
+
+static void VKAPI_PTR vk_free(void *pUserData, void *pMemory)
+{
+    (void)pUserData;
+    if (!pMemory)
+        return;
+    struct AllocHeader *header = (struct AllocHeader *)((uint8_t *)pMemory - sizeof(struct AllocHeader));
+    uint8_t *raw = (uint8_t *)pMemory - header->offset;
+    struct ScopeStats *stats = &host.scopes[header->scope];
+    atomic_fetch_add(&stats->frees, 1);
+    atomic_fetch_sub(&stats->bytes, (int64_t)header->size);
+    if (header->poolClass == POOL_CLASS_NONE)
+        free(raw);
+    else
+        pool_free(&host.pools[header->poolClass], raw);
+}
+
+static void *VKAPI_PTR vk_reallocation(void *pUserData, void *pOriginal, size_t size, size_t alignment,
+                                       VkSystemAllocationScope allocationScope)
+{
+    if (!pOriginal)
+        return vk_allocation(pUserData, size, alignment, allocationScope);
+    if (size == 0)
+    {
+        vk_free(pUserData, pOriginal);
+        return NULL;
+    }
+    struct AllocHeader *header = (struct AllocHeader *)((uint8_t *)pOriginal - sizeof(struct AllocHeader));
+    void *ptr = vk_allocation(pUserData, size, alignment, allocationScope);
+    if (!ptr)
+        return NULL; // original stays valid
+    memcpy(ptr, pOriginal, header->size < size ? header->size : size);
+    vk_free(pUserData, pOriginal);
+    atomic_fetch_add(&host.scopes[allocationScope].reallocations, 1);
+    return ptr;
+}
+
+static void VKAPI_PTR vk_internal_allocation(void *pUserData, size_t size, VkInternalAllocationType allocationType,
+                                             VkSystemAllocationScope allocationScope)
+{
+    (void)pUserData;
+    (void)allocationType;
+    atomic_fetch_add(&host.scopes[allocationScope].internalBytes, (int64_t)size);
+}
+
+static void VKAPI_PTR vk_internal_free(void *pUserData, size_t size, VkInternalAllocationType allocationType,
+                                       VkSystemAllocationScope allocationScope)
+{
+    (void)pUserData;
+    (void)allocationType;
+    atomic_fetch_sub(&host.scopes[allocationScope].internalBytes, (int64_t)size);
+}
+
+static const VkAllocationCallbacks vkAllocator = {
+    .pUserData = NULL,
+    .pfnAllocation = vk_allocation,
+    .pfnReallocation = vk_reallocation,
+    .pfnFree = vk_free,
+    .pfnInternalAllocation = vk_internal_allocation,
+    .pfnInternalFree = vk_internal_free,
+};
+
+void host_memory_init(void)
+{
+    for (int i = 0; i < POOL_CLASS_COUNT; i++)
+    {
+        pool_init(&host.pools[i], "vulkan", poolClassSizes[i], 4096 / poolClassSizes[i] * 16);
+    }
+    host.initialized = 1;
+}
+
+void host_memory_shutdown(void)
+{
+    if (!host.initialized)
+        return;
+    for (int i = 0; i < POOL_CLASS_COUNT; i++)
+    {
+        if (host.pools[i].blocksInUse)
+        {
+            logw("%llu blocks of %zu bytes still allocated by the driver",
+                 (unsigned long long)host.pools[i].blocksInUse, host.pools[i].blockSize);
+        }
+        pool_destroy(&host.pools[i]);
+    }
+    host.initialized = 0;
+}
+
+const VkAllocationCallbacks *host_vk_allocator(void)
+{
+    return &vkAllocator;
+}
+
+uint64_t host_memory_allocation_count(void)
+{
+    return atomic_load(&host.allocationCount);
+}
+
+void host_memory_report(void)
+{
+    for (int i = 0; i < SCOPE_COUNT; i++)
+    {
+        struct ScopeStats *stats = &host.scopes[i];
+        logi("[bench] host_memory scope=%s allocs=%llu reallocs=%llu frees=%llu live_bytes=%lld peak_bytes=%lld "
+             "internal_bytes=%lld",
+             scopeNames[i], (unsigned long long)atomic_load(&stats->allocations),
+             (unsigned long long)atomic_load(&stats->reallocations), (unsigned long long)atomic_load(&stats->frees),
+             (long long)atomic_load(&stats->bytes), (long long)atomic_load(&stats->peakBytes),
+             (long long)atomic_load(&stats->internalBytes));
+    }
+    for (int i = 0; i < POOL_CLASS_COUNT; i++)
+    {
+        logi("[bench] host_memory pool=%zu chunks=%u in_use=%llu peak=%llu", host.pools[i].blockSize,
+             host.pools[i].chunks_count, (unsigned long long)host.pools[i].blocksInUse,
+             (unsigned long long)host.pools[i].peakBlocksInUse);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef HOST_MEMORY_H
+#define HOST_MEMORY_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Linear allocator, everything is released at once with arena_reset. Not
+// thread safe, each arena belongs to one thread.
+struct HostArena
+{
+    const char *name;
+    uint8_t *base;
+    size_t size;
+    size_t used;
+    size_t peak;
+    uint64_t allocations;
+};
+
+void arena_init(struct HostArena *arena, const char *name, size_t size);
+void *arena_alloc(struct HostArena *arena, size_t size, size_t alignment);
+void arena_reset(struct HostArena *arena);
+void arena_destroy(struct HostArena *arena);
+void arena_report(const struct HostArena *arena);
+#define arena_alloc_array(arena, type, count) ((type *)arena_alloc((arena), sizeof(type) * (count), _Alignof(type)))
+
+// Fixed size blocks carved out of chunks, freed blocks go to a free list.
+// Thread safe.
+struct HostPool
+{
+    const char *name;
+    size_t blockSize;
+    size_t blocksPerChunk;
+    void *freeList;
+    void **chunks;
+    uint32_t chunks_count;
+    uint32_t chunks_capacity;
+    uint64_t blocksInUse;
+    uint64_t peakBlocksInUse;
+    pthread_mutex_t lock;
+};
+
+void pool_init(struct HostPool *pool, const char *name, size_t blockSize, size_t blocksPerChunk);
+void *pool_alloc(struct HostPool *pool);
+void pool_free(struct HostPool *pool, void *ptr);
+void pool_destroy(struct HostPool *pool);
+
+void host_memory_init(void);
+void host_memory_shutdown(void);
+// pass to every vkCreate*/vkDestroy*, routes driver host allocations through
+// the pools and accounts them per VkSystemAllocationScope
+const VkAllocationCallbacks *host_vk_allocator(void);
+// number of heap allocations made through host_vk_allocator so far, sample it
+// around a frame to see how many the hot path did
+uint64_t host_memory_allocation_count(void);
+void host_memory_report(void);
+
+#endif
@@ -5,17 +5,31 @@
 #include <GLFW/glfw3.h>
 
 #include "clib/log.h"
+#include "attachments.h"
+#include "capture.h"
+#include "device.h"
+#include "host_memory.h"
+#include "particles.h"
+#include "pipeline_cache.h"
+#include "resolution.h"
+#include "scene.h"
+#include "sprite_batch.h"
+#include "startup.h"
+#include "texture.h"
+#include "timing.h"
+#include "vk_util.h"
 
 #include "stdio.h"
 #include "stdlib.h"
 #include "string.h"
+#include <math.h>
 #include <stdint.h>
 
-typedef struct
-{
-    uint32_t *ptr;
-    size_t size;
-} code;
+#ifdef DISABLE_VALIDATION_LAYER
+static const int enableValidationLayers = 0;
+#else
+static const int enableValidationLayers = 1;
+#endif
 
 struct cleanup
 {
@@ -23,48 +37,6 @@ struct cleanup
     VkPipelineLayout pipelineLayout;
 } global;
 
-code read_shader(const char *filename)
-{
-    FILE *file = fopen(filename, "rb");
-    if (!file)
-    {
-        loge("Could not open file %s\n", filename);
-        fflush(stdout);
-        return (code){.size = 0, .ptr = NULL};
-    }
-
-    // Move the file pointer to the end of the file to determine file size
-    fseek(file, 0, SEEK_END);
-    size_t fileSize = ftell(file);
-    rewind(file); // Move file pointer back to the beginning
-
-    if (fileSize % sizeof(uint32_t) != 0)
-    {
-        loge("Invalid SPIR-V file size");
-        fclose(file);
-        return (code){.size = 0, .ptr = NULL};
-    }
-
-    // Allocate memory for the file content
-    uint32_t *content = (uint32_t *)malloc(fileSize);
-    if (!content)
-    {
-        loge("Memory allocation failed\n");
-        fclose(file);
-        return (code){.size = 0, .ptr = NULL};
-    }
-    size_t read_count = fread(content, 1, fileSize, file);
-    // Close the file and return the content
-    fclose(file);
-    if (read_count != fileSize)
-    {
-        loge("Failed to read full shader file");
-        exit(1);
-    }
-
-    return (code){.ptr = (uint32_t *)content, .size = fileSize};
-}
-
 void init_glfw()
 {
     glfwInit();
@@ -124,7 +96,7 @@ VkDebugUtilsMessengerEXT createDebugMessenger(VkInstance instance)
 
     if (function != NULL)
     {
-        if (function(instance, &createInfo, NULL, &messenger) != VK_SUCCESS)
+        if (function(instance, &createInfo, host_vk_allocator(), &messenger) != VK_SUCCESS)
         {
             loge("Couldn't set up debug messenger");
         }
@@ -151,6 +123,7 @@ VkInstance createInstance()
 {
 
     // check instance extension support
+    if (enableValidationLayers)
     {
         uint32_t extensionCount = 0;
         vkEnumerateInstanceExtensionProperties(0, &extensionCount, 0);
@@ -165,6 +138,7 @@ VkInstance createInstance()
 
     // check instance validation layer support
     const char *layersEnable[1] = {"VK_LAYER_KHRONOS_validation"};
+    if (enableValidationLayers)
     {
         uint32_t layerCount;
         vkEnumerateInstanceLayerProperties(&layerCount, NULL);
@@ -199,12 +173,6 @@ VkInstance createInstance()
                                          .engineVersion = VK_MAKE_VERSION(1, 0, 0),
                                          .apiVersion = VK_MAKE_VERSION(1, 4, 304)};
 
-#ifdef DISABLE_VALIDATION_LAYER
-    int enableValidationLayers = 0;
-#else
-    int enableValidationLayers = 1;
-#endif
-
     uint32_t glfwExtensionCount = 0;
     const char **glfwExtensions;
     glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
@@ -233,87 +201,12 @@ VkInstance createInstance()
 
     VkInstance instance;
     VkResult result;
-    if ((result = vkCreateInstance(&createInfo, NULL, &instance)) != VK_SUCCESS)
+    if ((result = vkCreateInstance(&createInfo, host_vk_allocator(), &instance)) != VK_SUCCESS)
     {
         loge("VkResult[%i]: Couldn't create vulkan instance!", result);
     }
     return instance;
 }
-struct QueueFamilyIndices
-{
-    int graphics_present;
-    int presentation_present;
-    int compute_present;
-    int raytrace_present;
-    uint32_t graphics;
-    uint32_t compute;
-    uint32_t raytrace;
-    uint32_t presentation;
-};
-VkPhysicalDevice pick_physical_device(VkInstance instance)
-{
-    VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
-
-    uint32_t deviceCount = 0;
-    vkEnumeratePhysicalDevices(instance, &deviceCount, NULL);
-    VkPhysicalDevice devices[deviceCount];
-    vkEnumeratePhysicalDevices(instance, &deviceCount, devices);
-    logi("%i devices found", deviceCount);
-
-    // select discrete gpu as physical device
-    VkPhysicalDeviceProperties deviceProperties = {0};
-    for (uint32_t i = 0; i < deviceCount; i++)
-    {
-        vkGetPhysicalDeviceProperties(devices[i], &deviceProperties);
-        logi("%s | %li", deviceProperties.deviceName, deviceProperties.vendorID);
-        if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU)
-        {
-            logi("Categorized as discrete: %s | %li", deviceProperties.deviceName, deviceProperties.vendorID);
-            physicalDevice = devices[i];
-            break;
-        }
-    }
-
-    if (physicalDevice == VK_NULL_HANDLE)
-    {
-        loge("No discrete GPU Found");
-        exit(1);
-    }
-    vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
-    logi("Picked device: %s | %li", deviceProperties.deviceName, deviceProperties.vendorID);
-    return physicalDevice;
-}
-struct QueueFamilyIndices get_queue_family(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
-{
-
-    uint32_t queueFamilyCount;
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, NULL);
-    VkQueueFamilyProperties queueProps[queueFamilyCount];
-    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueProps);
-    struct QueueFamilyIndices fam = {
-        .presentation_present = 0, .compute_present = 0, .graphics_present = 0, .raytrace_present = 0};
-    for (uint32_t i = 0; i < queueFamilyCount; i++)
-    {
-        if (queueProps[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)
-        {
-            fam.graphics_present = 1;
-            fam.graphics = i;
-        }
-        else if (queueProps[i].queueFlags & VK_QUEUE_COMPUTE_BIT)
-        {
-            fam.compute_present = 1;
-            fam.compute = i;
-        }
-        VkBool32 presentSupport = 0;
-        vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, surface, &presentSupport);
-        if (presentSupport)
-        {
-            fam.presentation_present = 1;
-            fam.presentation = i;
-        }
-    }
-    return fam;
-}
 
 VkDevice create_device(VkPhysicalDevice physicalDevice, struct QueueFamilyIndices queues)
 {
@@ -345,10 +238,10 @@ VkDevice create_device(VkPhysicalDevice physicalDevice, struct QueueFamilyIndice
                                              .ppEnabledLayerNames = layersEnable,
                                              .ppEnabledExtensionNames = extensions,
                                              .enabledExtensionCount = 1,
-                                             .enabledLayerCount = 1,
+                                             .enabledLayerCount = enableValidationLayers ? 1 : 0,
                                              .pEnabledFeatures = &vkPhysicalDeviceFeatures};
     VkDevice device = VK_NULL_HANDLE;
-    if (vkCreateDevice(physicalDevice, &vkDeviceCreateInfo, 0, &device) != VK_SUCCESS)
+    if (vkCreateDevice(physicalDevice, &vkDeviceCreateInfo, host_vk_allocator(), &device) != VK_SUCCESS)
     {
         loge("Couldn't create logical device!");
         exit(1);
@@ -359,21 +252,12 @@ VkDevice create_device(VkPhysicalDevice physicalDevice, struct QueueFamilyIndice
 VkSurfaceKHR create_surface(VkInstance instance, GLFWwindow *window)
 {
     VkSurfaceKHR surface;
-    if (glfwCreateWindowSurface(instance, window, NULL, &surface) != VK_SUCCESS)
+    if (glfwCreateWindowSurface(instance, window, host_vk_allocator(), &surface) != VK_SUCCESS)
     {
         loge("failed to create window surface!");
     }
     return surface;
 }
-struct SwapChainSupportDetails
-{
-    VkSurfaceCapabilitiesKHR capabilities;
-    VkSurfaceFormatKHR *formats;
-    uint32_t formats_count;
-    VkPresentModeKHR *presentModes;
-    uint32_t presentModes_count;
-};
-
 uint32_t clamp(uint32_t d, uint32_t min, uint32_t max)
 {
     const uint32_t t = d < min ? min : d;
@@ -387,96 +271,80 @@ void print_swap_chain_details(VkSwapchainCreateInfoKHR details)
     printf("extentH: %i\n", details.imageExtent.height);
     printf("extentW: %i\n", details.imageExtent.width);
 }
-VkSwapchainCreateInfoKHR querySwapChainSupportDetails(VkPhysicalDevice device, VkSurfaceKHR surface, GLFWwindow *window)
+VkSwapchainCreateInfoKHR querySwapChainSupportDetails(VkPhysicalDevice device, VkSurfaceKHR surface, GLFWwindow *window,
+                                                      const struct DeviceInfo *details)
 {
-    struct SwapChainSupportDetails details;
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
-
-    vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &details.formats_count, NULL);
-    if (details.formats_count != 0)
-    {
-        details.formats = malloc(sizeof(VkSurfaceFormatKHR) * details.formats_count);
-        vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &details.formats_count, details.formats);
-    }
-
-    vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &details.presentModes_count, NULL);
-    if (details.presentModes_count != 0)
-    {
-        details.presentModes = malloc(sizeof(VkPresentModeKHR) * details.presentModes_count);
-        vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &details.presentModes_count, details.presentModes);
-        for (size_t i = 0; i < details.presentModes_count; i++)
-        {
-            logi("Present mode %i : %i", i, details.presentModes[i]);
-        }
-    }
-    int swapChainAdequate = 0;
-    swapChainAdequate = !details.formats_count && !details.presentModes_count;
-    if (swapChainAdequate)
+    // formats and present modes come from the device cache, the capabilities
+    // follow the window size so they are always queried
+    VkSurfaceCapabilitiesKHR capabilities;
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &capabilities);
+    for (size_t i = 0; i < details->presentModes_count; i++)
     {
-        loge("Swap chain support not adequeate");
-        exit(1);
+        logi("Present mode %i : %i", i, details->presentModes[i]);
     }
     // create swapchain
     // choose surface format
     VkSurfaceFormatKHR sformat;
     {
         int found = 0;
-        for (uint32_t i = 0; i < details.formats_count; i++)
+        for (uint32_t i = 0; i < details->formats_count; i++)
         {
-            if (details.formats[i].format == VK_FORMAT_B8G8R8A8_SRGB &&
-                details.formats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+            if (details->formats[i].format == VK_FORMAT_B8G8R8A8_SRGB &&
+                details->formats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
             {
                 found = 1;
-                sformat = details.formats[i];
+                sformat = details->formats[i];
                 break;
             }
         }
         if (!found)
         {
-            sformat = details.formats[0];
+            sformat = details->formats[0];
         }
     }
     VkPresentModeKHR presentMode;
     {
         int found = 0;
-        for (uint32_t i = 0; i < details.presentModes_count; i++)
+        for (uint32_t i = 0; i < details->presentModes_count; i++)
         {
-            if (details.presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
+            if (details->presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
             {
                 found = 1;
-                presentMode = details.presentModes[i];
+                presentMode = details->presentModes[i];
                 break;
             }
         }
         if (!found)
         {
-            presentMode = details.presentModes[0];
+            presentMode = details->presentModes[0];
         }
     }
     // choose VkExtent2D
     VkExtent2D vkExtent;
     {
-        if (details.capabilities.currentExtent.width != UINT32_MAX)
+        if (capabilities.currentExtent.width != UINT32_MAX)
         {
-            vkExtent = details.capabilities.currentExtent;
+            vkExtent = capabilities.currentExtent;
         }
         else
         {
             // upto us to determine swapchain image size
             int width, height;
             glfwGetFramebufferSize(window, &width, &height);
-            vkExtent.width =
-                clamp(width, details.capabilities.minImageExtent.width, details.capabilities.maxImageExtent.width);
-            vkExtent.height =
-                clamp(height, details.capabilities.minImageExtent.height, details.capabilities.maxImageExtent.height);
+            vkExtent.width = clamp(width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+            vkExtent.height = clamp(height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
         }
     }
-    uint32_t image_count = details.capabilities.minImageCount + 1;
-    if (details.capabilities.maxImageCount > 0 && image_count > details.capabilities.maxImageCount)
+    uint32_t image_count = capabilities.minImageCount + 1;
+    if (capabilities.maxImageCount > 0 && image_count > capabilities.maxImageCount)
     {
-        image_count = details.capabilities.maxImageCount;
+        image_count = capabilities.maxImageCount;
     }
     logi("Swapchain image count: %li", image_count);
+    // transfer src lets capture copy the images out, transfer dst lets a scaled render target be blitted in
+    VkImageUsageFlags imageUsage =
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+        (capabilities.supportedUsageFlags & (VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT));
     VkSwapchainCreateInfoKHR swapchainCreateInfo = {.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
                                                     .surface = surface,
                                                     .minImageCount = image_count,
@@ -484,20 +352,18 @@ VkSwapchainCreateInfoKHR querySwapChainSupportDetails(VkPhysicalDevice device, V
                                                     .imageColorSpace = sformat.colorSpace,
                                                     .imageExtent = vkExtent,
                                                     .imageArrayLayers = 1,
-                                                    .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-                                                    .preTransform = details.capabilities.currentTransform,
+                                                    .imageUsage = imageUsage,
+                                                    .preTransform = capabilities.currentTransform,
                                                     .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
                                                     .presentMode = presentMode,
                                                     .clipped = VK_TRUE,
                                                     .oldSwapchain = VK_NULL_HANDLE};
     print_swap_chain_details(swapchainCreateInfo);
-    struct QueueFamilyIndices indices = get_queue_family(device, surface);
-    if (indices.graphics != indices.presentation)
+    if (details->queues.graphics != details->queues.presentation)
     {
-        uint32_t q[2] = {indices.graphics, indices.presentation};
         swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
         swapchainCreateInfo.queueFamilyIndexCount = 2;
-        swapchainCreateInfo.pQueueFamilyIndices = q;
+        swapchainCreateInfo.pQueueFamilyIndices = details->swapchainFamilies;
     }
     else
     {
@@ -505,9 +371,10 @@ VkSwapchainCreateInfoKHR querySwapChainSupportDetails(VkPhysicalDevice device, V
     }
     return swapchainCreateInfo;
 }
-VkImageView *getImageViews(VkDevice device, VkFormat format, uint32_t count, VkImage *images)
+VkImageView *getImageViews(VkDevice device, VkFormat format, uint32_t count, VkImage *images,
+                           struct HostArena *arena)
 {
-    VkImageView *r = malloc(count * sizeof(VkImageView));
+    VkImageView *r = arena_alloc_array(arena, VkImageView, count);
     for (uint32_t i = 0; i < count; i++)
     {
         VkImageViewCreateInfo createInfo =
@@ -524,7 +391,7 @@ VkImageView *getImageViews(VkDevice device, VkFormat format, uint32_t count, VkI
                                                          .layerCount = 1}
 
             };
-        if (vkCreateImageView(device, &createInfo, NULL, &r[i]) != VK_SUCCESS)
+        if (vkCreateImageView(device, &createInfo, host_vk_allocator(), &r[i]) != VK_SUCCESS)
         {
             loge("failed to create image views!");
         }
@@ -532,67 +399,100 @@ VkImageView *getImageViews(VkDevice device, VkFormat format, uint32_t count, VkI
     return r;
 }
 
-VkShaderModule createShaderModule(VkDevice device, code code)
-{
-    VkShaderModuleCreateInfo createInfo = {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, .codeSize = code.size, .pCode = code.ptr};
-    VkShaderModule shaderModule;
-    if (vkCreateShaderModule(device, &createInfo, NULL, &shaderModule) != VK_SUCCESS)
-    {
-        loge("failed to create shader module!");
-        exit(1);
-    }
-    return shaderModule;
-}
-void create_renderpass(VkDevice device, VkFormat format)
+// Attachment 0 is color, 1 depth and with MSAA 2 the image color is resolved
+// into at the end of the subpass. Only that image is stored, multisampled
+// color and depth are cleared on load and discarded. It ends up in
+// `finalLayout`: PRESENT_SRC_KHR for a swapchain image, TRANSFER_SRC_OPTIMAL
+// for a render target that is blitted to the swapchain.
+void create_renderpass(VkDevice device, VkFormat format, VkFormat depthFormat, VkSampleCountFlagBits samples,
+                       VkImageLayout finalLayout)
 {
-    VkAttachmentDescription colorAttachment = {.format = format,
-                                               .samples = VK_SAMPLE_COUNT_1_BIT,
-                                               .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-                                               .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-                                               .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-                                               .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-                                               .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-                                               .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+    int msaa = samples != VK_SAMPLE_COUNT_1_BIT;
+    VkAttachmentDescription attachments[3] = {
+        {.format = format,
+         .samples = samples,
+         .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+         .storeOp = msaa ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+         .finalLayout = msaa ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : finalLayout},
+        {.format = depthFormat,
+         .samples = samples,
+         .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+         .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+         .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL},
+        {.format = format,
+         .samples = VK_SAMPLE_COUNT_1_BIT,
+         .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+         .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+         .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+         .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+         .finalLayout = finalLayout},
+    };
 
     VkAttachmentReference colorAttachmentRef = {.attachment = 0, .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+    VkAttachmentReference depthAttachmentRef = {.attachment = 1,
+                                                .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+    VkAttachmentReference resolveAttachmentRef = {.attachment = 2,
+                                                  .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
 
     VkSubpassDescription subpass = {.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
                                     .colorAttachmentCount = 1,
-                                    .pColorAttachments = &colorAttachmentRef};
-    VkSubpassDependency dependecy = {
+                                    .pColorAttachments = &colorAttachmentRef,
+                                    .pResolveAttachments = msaa ? &resolveAttachmentRef : NULL,
+                                    .pDepthStencilAttachment = &depthAttachmentRef};
+    // depth is cleared every frame, the previous frame's depth tests have to be done first
+    VkSubpassDependency dependencies[2] = {{
         .srcSubpass = VK_SUBPASS_EXTERNAL,
         .dstSubpass = 0,
-        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .srcAccessMask = 0,
-        .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-    };
+        .srcStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+        .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+        .dstStageMask =
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+    }};
+    // a render target is blitted from right after the pass, the implicit dependency to external only reaches
+    // BOTTOM_OF_PIPE so the blit would not be ordered after the final layout transition
+    uint32_t dependencies_count = 1;
+    if (finalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+    {
+        dependencies[dependencies_count++] = (VkSubpassDependency){
+            .srcSubpass = 0,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+        };
+    }
 
     VkRenderPassCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
         .pSubpasses = &subpass,
-        .pDependencies = &dependecy,
-        .dependencyCount = 1,
+        .pDependencies = dependencies,
+        .dependencyCount = dependencies_count,
         .subpassCount = 1,
-        .attachmentCount = 1,
-        .pAttachments = &colorAttachment,
+        .attachmentCount = msaa ? 3 : 2,
+        .pAttachments = attachments,
     };
-    if (vkCreateRenderPass(device, &createInfo, NULL, &global.renderPass) != VK_SUCCESS)
+    if (vkCreateRenderPass(device, &createInfo, host_vk_allocator(), &global.renderPass) != VK_SUCCESS)
     {
         loge("failed to create render pass!");
     }
 }
-VkPipeline createGraphicsPipeline(VkDevice device, VkExtent2D swapchainExtent, VkFormat format)
+// the shader code stays owned by the caller
+VkPipeline createGraphicsPipeline(VkDevice device, VkPipelineCache pipelineCache, VkExtent2D swapchainExtent,
+                                  VkFormat format, VkFormat depthFormat, VkSampleCountFlagBits samples,
+                                  VkImageLayout finalLayout, code vertex, code frag)
 {
-    code vertex = read_shader("vert.spv");
-    code frag = read_shader("frag.spv");
     VkShaderModule vertexModule = createShaderModule(device, vertex);
     VkShaderModule fragModule = createShaderModule(device, frag);
-    free(vertex.ptr);
-    free(frag.ptr);
-    vertex.ptr = NULL;
-    frag.ptr = NULL;
 
     VkPipelineShaderStageCreateInfo vertexStage = {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
                                                    .stage = VK_SHADER_STAGE_VERTEX_BIT,
@@ -647,7 +547,7 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkExtent2D swapchainExtent, V
     VkPipelineMultisampleStateCreateInfo multisampling = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
         .sampleShadingEnable = VK_FALSE,
-        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .rasterizationSamples = samples,
         .minSampleShading = 1.0f,          // Optional
         .pSampleMask = NULL,               // Optional
         .alphaToCoverageEnable = VK_FALSE, // Optional
@@ -665,11 +565,18 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkExtent2D swapchainExtent, V
                                                          .blendConstants = {0, 0, 0, 0},
                                                          .attachmentCount = 1,
                                                          .pAttachments = &colorBlendAttachment};
-    create_renderpass(device, format);
+    VkPipelineDepthStencilStateCreateInfo depthStencil = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = VK_TRUE,
+        .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL,
+        .depthBoundsTestEnable = VK_FALSE,
+        .stencilTestEnable = VK_FALSE};
+    create_renderpass(device, format, depthFormat, samples, finalLayout);
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO, .setLayoutCount = 0, .pushConstantRangeCount = 0};
-    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL, &global.pipelineLayout) != VK_SUCCESS)
+    if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, host_vk_allocator(), &global.pipelineLayout) != VK_SUCCESS)
     {
         loge("failed to create pipeline layout!");
     }
@@ -682,6 +589,7 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkExtent2D swapchainExtent, V
                                                  .pViewportState = &viewportState,
                                                  .pRasterizationState = &rasterizer,
                                                  .pMultisampleState = &multisampling,
+                                                 .pDepthStencilState = &depthStencil,
                                                  .pColorBlendState = &colorBlending,
                                                  .pDynamicState = &dynamicState,
                                                  .layout = global.pipelineLayout,
@@ -689,32 +597,44 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkExtent2D swapchainExtent, V
                                                  .subpass = 0,
                                                  .basePipelineHandle = VK_NULL_HANDLE};
     VkPipeline graphicsPipeline;
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL, &graphicsPipeline) != VK_SUCCESS)
+    if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, host_vk_allocator(), &graphicsPipeline) !=
+        VK_SUCCESS)
     {
         loge("failed to create graphics pipeline!");
     }
-    vkDestroyShaderModule(device, fragModule, NULL);
-    vkDestroyShaderModule(device, vertexModule, NULL);
+    vkDestroyShaderModule(device, fragModule, host_vk_allocator());
+    vkDestroyShaderModule(device, vertexModule, host_vk_allocator());
     return graphicsPipeline;
 }
 
+// the transient attachments are shared, only one frame is in flight
 VkFramebuffer *createFrameBuffers(VkDevice device, VkExtent2D swapchainExtent, VkImageView *views,
-                                  uint32_t swapchainImages_count)
+                                  uint32_t swapchainImages_count, const struct Attachments *attachments,
+                                  struct HostArena *arena)
 {
 
-    VkFramebuffer *framebuffers = malloc(sizeof(VkFramebuffer) * swapchainImages_count);
+    VkFramebuffer *framebuffers = arena_alloc_array(arena, VkFramebuffer, swapchainImages_count);
     for (uint32_t i = 0; i < swapchainImages_count; i++)
     {
+        // same order as in create_renderpass
+        VkImageView imageViews[3] = {views[i], attachments->depth.view, VK_NULL_HANDLE};
+        uint32_t imageViews_count = 2;
+        if (attachments->samples != VK_SAMPLE_COUNT_1_BIT)
+        {
+            imageViews[0] = attachments->color.view;
+            imageViews[2] = views[i];
+            imageViews_count = 3;
+        }
         VkFramebufferCreateInfo framebufferInfo = {};
         framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
         framebufferInfo.renderPass = global.renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = &views[i];
+        framebufferInfo.attachmentCount = imageViews_count;
+        framebufferInfo.pAttachments = imageViews;
         framebufferInfo.width = swapchainExtent.width;
         framebufferInfo.height = swapchainExtent.height;
         framebufferInfo.layers = 1;
 
-        if (vkCreateFramebuffer(device, &framebufferInfo, NULL, &framebuffers[i]) != VK_SUCCESS)
+        if (vkCreateFramebuffer(device, &framebufferInfo, host_vk_allocator(), &framebuffers[i]) != VK_SUCCESS)
         {
             loge("failed to create framebuffer!");
         }
@@ -727,7 +647,7 @@ VkCommandPool createCommandPool(VkDevice device, struct QueueFamilyIndices q)
     VkCommandPoolCreateInfo poolInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
                                         .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
                                         .queueFamilyIndex = q.graphics};
-    if (vkCreateCommandPool(device, &poolInfo, NULL, &pCommandPool) != VK_SUCCESS)
+    if (vkCreateCommandPool(device, &poolInfo, host_vk_allocator(), &pCommandPool) != VK_SUCCESS)
     {
         loge("Could'nt create command pool for graphics queue");
     }
@@ -747,20 +667,36 @@ VkCommandBuffer createCommandBuffer(VkDevice device, VkCommandPool commandPool)
     }
     return buffer;
 }
-void recordCommandBuffer(VkCommandBuffer buffer, VkFramebuffer framebuffer, VkPipeline pipeline, VkExtent2D imageExtent)
+void beginCommandBuffer(VkCommandBuffer buffer)
 {
-    VkCommandBufferBeginInfo beginInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    VkCommandBufferBeginInfo beginInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                                          .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
     if (vkBeginCommandBuffer(buffer, &beginInfo) != VK_SUCCESS)
     {
         loge("Couldn't record command buffer");
     }
-    VkClearValue clearColor = {{{0, 0, 0, 1}}};
+}
+void endCommandBuffer(VkCommandBuffer buffer)
+{
+    if (vkEndCommandBuffer(buffer) != VK_SUCCESS)
+    {
+        loge("Failed to record command buffer");
+    }
+}
+// records the render pass, the buffer has to be begun already. Renders into the
+// top left `imageExtent` of the framebuffer, sprites are positioned in
+// `screenExtent` pixels whatever the render resolution is.
+void recordCommandBuffer(VkCommandBuffer buffer, VkFramebuffer framebuffer, VkPipeline pipeline, VkExtent2D imageExtent,
+                         VkExtent2D screenExtent, struct Particles *particles, struct SpriteBatch *sprites)
+{
+    // color, depth; the resolve attachment isn't cleared
+    VkClearValue clearValues[2] = {{.color = {{0, 0, 0, 1}}}, {.depthStencil = {1.0f, 0}}};
     VkRenderPassBeginInfo rBeginInfo = {.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
                                         .renderPass = global.renderPass,
                                         .renderArea = {.offset = {0, 0}, .extent = imageExtent},
                                         .framebuffer = framebuffer,
-                                        .clearValueCount = 1,
-                                        .pClearValues = &clearColor};
+                                        .clearValueCount = 2,
+                                        .pClearValues = clearValues};
     vkCmdBeginRenderPass(buffer, &rBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
     // bind stuff
     vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
@@ -777,17 +713,15 @@ void recordCommandBuffer(VkCommandBuffer buffer, VkFramebuffer framebuffer, VkPi
 
     // thank finally god
     vkCmdDraw(buffer, 3, 1, 0, 0);
+    particles_draw(particles, buffer);
+    sprite_batch_draw(sprites, buffer, screenExtent);
     vkCmdEndRenderPass(buffer);
-    if (vkEndCommandBuffer(buffer) != VK_SUCCESS)
-    {
-        loge("Failed to record command buffer");
-    }
 }
 VkSemaphore createSemaphore(VkDevice device)
 {
     VkSemaphore waitForAcquire;
-    if (vkCreateSemaphore(device, &(VkSemaphoreCreateInfo){.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO}, NULL,
-                          &waitForAcquire) != VK_SUCCESS)
+    if (vkCreateSemaphore(device, &(VkSemaphoreCreateInfo){.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO},
+                          host_vk_allocator(), &waitForAcquire) != VK_SUCCESS)
     {
         loge("falied to create semaphore");
     }
@@ -799,24 +733,323 @@ VkFence createFence(VkDevice device)
     if (vkCreateFence(
             device,
             &(VkFenceCreateInfo){.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, .flags = VK_FENCE_CREATE_SIGNALED_BIT},
-            NULL, &waitForAcquire) != VK_SUCCESS)
+            host_vk_allocator(), &waitForAcquire) != VK_SUCCESS)
     {
         loge("falied to create fence");
     }
     return waitForAcquire;
 }
 
-int main()
+struct Options
+{
+    uint64_t max_frames;       // 0 = run until the window is closed
+    const char *device;        // index or name of the device to use, NULL = best score
+    uint32_t capture_interval; // capture every n-th frame, 0 = off
+    const char *capture_dir;
+    enum CaptureFormat capture_format;
+    const char *textures[64];   // ktx2 files to stream
+    uint32_t textures_count;    // --texture can be repeated
+    uint32_t texture_budget_mb; // device memory for textures
+    uint32_t upload_budget_kb;  // texture uploads per frame
+    int serial_startup;         // no startup work on worker threads
+    uint32_t particles;         // simulated on the GPU, 0 = off
+    uint32_t sprites;           // demo sprites per frame, 0 = off
+    uint32_t msaa;              // samples per pixel, clamped to what the device supports
+    int lazy_attachments;       // back transient attachments with lazily allocated memory if possible
+    uint32_t sim_hz;            // simulation steps per second, independent of the frame rate
+    uint32_t window_width;
+    uint32_t window_height;
+    float render_scale;   // of the swapchain extent per axis; the start value with a GPU budget
+    double gpu_budget_ms; // GPU frame time the render scale is adjusted to, 0 = fixed scale
+};
+
+struct Options parse_options(int argc, char **argv)
 {
+    struct Options options = {.max_frames = 0,
+                              .device = NULL,
+                              .capture_interval = 0,
+                              .capture_dir = "capture",
+                              .capture_format = CAPTURE_PNG,
+                              .textures_count = 0,
+                              .texture_budget_mb = 256,
+                              .upload_budget_kb = 4096,
+                              .serial_startup = 0,
+                              .particles = 0,
+                              .sprites = 0,
+                              .msaa = 1,
+                              .lazy_attachments = 1,
+                              .sim_hz = 60,
+                              .window_width = 1280,
+                              .window_height = 720,
+                              .render_scale = 1.0f,
+                              .gpu_budget_ms = 0.0};
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            options.max_frames = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+        {
+            options.device = argv[++i];
+        }
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+        {
+            options.capture_interval = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--capture-dir") == 0 && i + 1 < argc)
+        {
+            options.capture_dir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--capture-raw") == 0)
+        {
+            options.capture_format = CAPTURE_RAW;
+        }
+        else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc)
+        {
+            if (options.textures_count < sizeof(options.textures) / sizeof(options.textures[0]))
+                options.textures[options.textures_count++] = argv[++i];
+            else
+                logw("Too many textures, ignoring %s", argv[++i]);
+        }
+        else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+        {
+            options.texture_budget_mb = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--upload-budget") == 0 && i + 1 < argc)
+        {
+            options.upload_budget_kb = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--serial-startup") == 0)
+        {
+            options.serial_startup = 1;
+        }
+        else if (strcmp(argv[i], "--particles") == 0 && i + 1 < argc)
+        {
+            options.particles = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--sprites") == 0 && i + 1 < argc)
+        {
+            options.sprites = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--msaa") == 0 && i + 1 < argc)
+        {
+            options.msaa = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--no-lazy") == 0)
+        {
+            options.lazy_attachments = 0;
+        }
+        else if (strcmp(argv[i], "--sim-hz") == 0 && i + 1 < argc)
+        {
+            options.sim_hz = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc)
+        {
+            uint32_t width, height;
+            if (sscanf(argv[++i], "%ux%u", &width, &height) == 2 && width > 0 && height > 0)
+            {
+                options.window_width = width;
+                options.window_height = height;
+            }
+            else
+            {
+                logw("Invalid window size %s, expected WIDTHxHEIGHT", argv[i]);
+            }
+        }
+        else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc)
+        {
+            options.render_scale = strtof(argv[++i], NULL);
+        }
+        else if (strcmp(argv[i], "--gpu-budget") == 0 && i + 1 < argc)
+        {
+            options.gpu_budget_ms = strtod(argv[++i], NULL);
+        }
+        else
+        {
+            logw("Unknown option %s", argv[i]);
+        }
+    }
+    return options;
+}
+
+// startup work that runs on worker threads, see startup.h
+
+// only needs glfw's extension list, no window
+struct InstanceTask
+{
+    VkInstance instance;
+    struct PhysicalDevices devices;
+};
+
+static void instance_task(void *arg)
+{
+    struct InstanceTask *task = arg;
+    task->instance = createInstance();
+    enumerate_physical_devices(task->instance, &task->devices);
+}
+
+struct AssetTask
+{
+    int particles; // load the particle shaders too
+    int sprites;   // load the sprite shaders too
+    code vertex;
+    code frag;
+    code particleCompute;
+    code particleVertex;
+    code spriteVertex;
+    code spriteFrag;
+    struct PipelineCacheData pipelineCache;
+};
+
+static void asset_task(void *arg)
+{
+    struct AssetTask *task = arg;
+    task->vertex = read_shader("vert.spv");
+    task->frag = read_shader("frag.spv");
+    if (task->particles)
+    {
+        task->particleCompute = read_shader("particles_comp.spv");
+        task->particleVertex = read_shader("particles_vert.spv");
+    }
+    if (task->sprites)
+    {
+        task->spriteVertex = read_shader("sprite_vert.spv");
+        task->spriteFrag = read_shader("sprite_frag.spv");
+    }
+    pipeline_cache_read(PIPELINE_CACHE_FILE, &task->pipelineCache);
+}
+
+// only needs the swapchain format and extent, not the swapchain itself
+struct PipelineTask
+{
+    VkDevice device;
+    const VkPhysicalDeviceProperties *properties;
+    VkExtent2D extent;
+    VkFormat format;
+    VkFormat depthFormat;
+    VkSampleCountFlagBits samples;
+    VkImageLayout finalLayout;
+    struct AssetTask *assets;
+    VkPipelineCache cache;
+    VkPipeline pipeline;
+};
+
+static void pipeline_task(void *arg)
+{
+    struct PipelineTask *task = arg;
+    task->cache = pipeline_cache_create(task->device, task->properties, &task->assets->pipelineCache);
+    task->pipeline = createGraphicsPipeline(task->device, task->cache, task->extent, task->format,
+                                            task->depthFormat, task->samples, task->finalLayout,
+                                            task->assets->vertex, task->assets->frag);
+}
+
+// deferred until after the first present
+
+static void save_device_cache_task(void *arg)
+{
+    save_device_cache(arg);
+}
+
+struct TextureLoad
+{
+    struct TextureManager *manager;
+    const struct Options *options;
+};
+
+static void load_textures_task(void *arg)
+{
+    struct TextureLoad *load = arg;
+    for (uint32_t t = 0; t < load->options->textures_count; t++)
+    {
+        texture_load_ktx2(load->manager, load->options->textures[t]);
+    }
+}
+
+// what the simulation thread reads, fixed once it runs
+struct DemoScene
+{
+    const struct TextureManager *textures;
+    uint32_t sprites;
+    VkExtent2D extent;
+};
+
+// moving quads spread over 4 layers, both blend modes and every texture
+static void demo_scene_step(struct FramePacket *packet, void *arg)
+{
+    const struct DemoScene *scene = arg;
+    const struct TextureManager *textures = scene->textures;
+    for (uint32_t s = 0; s < scene->sprites; s++)
+    {
+        // cheap integer hash, stable per sprite
+        uint32_t h = s * 2654435761u;
+        h ^= h >> 15;
+        h *= 2246822519u;
+        h ^= h >> 13;
+        float fx = (float)(h & 0xffff) / 65535.0f;
+        float fy = (float)(h >> 16) / 65535.0f;
+        float size = 8.0f + (float)(h & 31);
+        float phase = packet->time * (0.5f + fy) + fx * 6.2831853f;
+        struct Sprite sprite = {
+            .x = fx * (float)scene->extent.width + 32.0f * cosf(phase),
+            .y = fy * (float)scene->extent.height + 32.0f * sinf(phase),
+            .w = size,
+            .h = size,
+            .u0 = 0.0f,
+            .v0 = 0.0f,
+            .u1 = 1.0f,
+            .v1 = 1.0f,
+            .color = (h | 0xff000000u) & 0xc0ffffffu,
+            .layer = (uint8_t)(s & 3),
+            .pipeline = (h >> 7) & 1 ? SPRITE_PIPELINE_ADDITIVE : SPRITE_PIPELINE_ALPHA,
+            .texture = textures->textures_count ? textures->textures[(h >> 9) % textures->textures_count] : NULL};
+        if (!scene_add_sprite(packet, &sprite))
+            break;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    double startTime = time_ms();
+    struct Options options = parse_options(argc, argv);
+    logi("Build configuration: %s", BUILD_CONFIG);
+    struct Startup startup;
+    startup_init(&startup, startTime, options.serial_startup);
+
+    // swapchain lifetime arrays live in swapchainArena, per frame scratch in frameArena
+    startup_phase(&startup, "host_memory");
+    host_memory_init();
+    struct HostArena swapchainArena;
+    struct HostArena frameArena;
+    arena_init(&swapchainArena, "swapchain", 64 * 1024);
+    arena_init(&frameArena, "frame", 4 * 1024 * 1024 + sprite_batch_scratch_size(options.sprites));
+
+    startup_phase(&startup, "glfw_init");
     init_glfw();
-    GLFWwindow *window = create_glfw_window(4096, 4096, "Vulkan window");
+    // instance creation, device enumeration and file reads overlap window creation
+    struct InstanceTask instanceTask;
+    struct StartupTask instanceJob;
+    startup_spawn(&startup, &instanceJob, "instance_and_devices", instance_task, &instanceTask);
+    struct AssetTask assets = {.particles = options.particles > 0, .sprites = options.sprites > 0};
+    struct StartupTask assetJob;
+    startup_spawn(&startup, &assetJob, "shaders_and_pipeline_cache", asset_task, &assets);
+
+    startup_phase(&startup, "window");
+    GLFWwindow *window = create_glfw_window(options.window_width, options.window_height, "Vulkan window");
 
-    VkInstance instance = createInstance();                                   // not checked
-    VkSurfaceKHR surface = create_surface(instance, window);                  // checked
-    VkDebugUtilsMessengerEXT debugMessenger = createDebugMessenger(instance); // checked
+    startup_join(&startup, &instanceJob);
+    startup_phase(&startup, "surface_and_device");
+    VkInstance instance = instanceTask.instance;             // not checked
+    VkSurfaceKHR surface = create_surface(instance, window); // checked
+    VkDebugUtilsMessengerEXT debugMessenger = VK_NULL_HANDLE;
+    if (enableValidationLayers)
+    {
+        debugMessenger = createDebugMessenger(instance); // checked
+    }
+    struct DeviceInfo deviceInfo;
     VkPhysicalDevice physicalDevice =
-        pick_physical_device(instance); // TODO: will check logs to see if proper device is getting picked
-    struct QueueFamilyIndices queues = get_queue_family(physicalDevice, surface);
+        pick_physical_device(&instanceTask.devices, surface, options.device, &deviceInfo);
+    struct QueueFamilyIndices queues = deviceInfo.queues;
     VkDevice device = create_device(physicalDevice, queues);
     VkQueue graphicsQueue = VK_NULL_HANDLE;
     vkGetDeviceQueue(device, queues.graphics, 0, &graphicsQueue);
@@ -824,9 +1057,33 @@ int main()
     vkGetDeviceQueue(device, queues.presentation, 0, &presentQueue);
 
     // swap chain
-    VkSwapchainCreateInfoKHR vkSwapChainCreateInfo = querySwapChainSupportDetails(physicalDevice, surface, window);
+    VkSwapchainCreateInfoKHR vkSwapChainCreateInfo =
+        querySwapChainSupportDetails(physicalDevice, surface, window, &deviceInfo);
+
+    // render into a separate target only if it is going to be scaled, otherwise straight into the swapchain
+    int scaled = options.render_scale < 1.0f || options.gpu_budget_ms > 0.0;
+    if (scaled && !resolution_supported(physicalDevice, &vkSwapChainCreateInfo))
+    {
+        logw("Swapchain images can't be blitted to, rendering at full resolution");
+        scaled = 0;
+    }
+
+    startup_join(&startup, &assetJob);
+    struct PipelineTask pipelineTask = {.device = device,
+                                        .properties = &deviceInfo.properties,
+                                        .extent = vkSwapChainCreateInfo.imageExtent,
+                                        .format = vkSwapChainCreateInfo.imageFormat,
+                                        .depthFormat = attachments_pick_depth_format(physicalDevice),
+                                        .samples = attachments_pick_samples(&deviceInfo.properties, options.msaa),
+                                        .finalLayout = scaled ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                                              : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                        .assets = &assets};
+    struct StartupTask pipelineJob;
+    startup_spawn(&startup, &pipelineJob, "pipeline", pipeline_task, &pipelineTask);
+
+    startup_phase(&startup, "swapchain");
     VkSwapchainKHR swapchain;
-    if (vkCreateSwapchainKHR(device, &vkSwapChainCreateInfo, NULL, &swapchain) != VK_SUCCESS)
+    if (vkCreateSwapchainKHR(device, &vkSwapChainCreateInfo, host_vk_allocator(), &swapchain) != VK_SUCCESS)
     {
         loge("failed to create swap chain!");
     }
@@ -835,36 +1092,152 @@ int main()
     uint32_t swapchainImages_count;
     {
         vkGetSwapchainImagesKHR(device, swapchain, &swapchainImages_count, NULL);
-        swapchainImages = malloc(sizeof(VkImage) * swapchainImages_count);
+        swapchainImages = arena_alloc_array(&swapchainArena, VkImage, swapchainImages_count);
         vkGetSwapchainImagesKHR(device, swapchain, &swapchainImages_count, swapchainImages);
     }
-    VkImageView *swapchainImageViews =
-        getImageViews(device, vkSwapChainCreateInfo.imageFormat, swapchainImages_count, swapchainImages);
+    VkImageView *swapchainImageViews = getImageViews(device, vkSwapChainCreateInfo.imageFormat, swapchainImages_count,
+                                                     swapchainImages, &swapchainArena);
 
-    VkPipeline graphicsPipeline =
-        createGraphicsPipeline(device, vkSwapChainCreateInfo.imageExtent, vkSwapChainCreateInfo.imageFormat);
+    startup_join(&startup, &pipelineJob);
+    startup_phase(&startup, "frame_resources");
+    VkPipelineCache pipelineCache = pipelineTask.cache;
+    VkPipeline graphicsPipeline = pipelineTask.pipeline;
+    struct Particles particles;
+    if (!particles_init(&particles, physicalDevice, device, &deviceInfo, options.particles, global.renderPass,
+                        pipelineTask.samples, pipelineCache, assets.particleCompute, assets.particleVertex,
+                        assets.frag))
+    {
+        loge("failed to create particles!");
+        exit(1);
+    }
+    struct Attachments attachments;
+    if (!attachments_init(&attachments, device, &deviceInfo.memory, vkSwapChainCreateInfo.imageExtent,
+                          vkSwapChainCreateInfo.imageFormat, pipelineTask.depthFormat, pipelineTask.samples,
+                          options.lazy_attachments))
+    {
+        loge("failed to create attachments!");
+        exit(1);
+    }
+    struct Resolution resolution;
+    if (!resolution_init(&resolution, physicalDevice, device, &deviceInfo, scaled, vkSwapChainCreateInfo.imageFormat,
+                         vkSwapChainCreateInfo.imageExtent, options.render_scale, options.gpu_budget_ms))
+    {
+        loge("failed to create render target!");
+        exit(1);
+    }
+    // one for the render target or one per swapchain image
+    uint32_t framebuffers_count = scaled ? 1 : swapchainImages_count;
     VkFramebuffer *framebuffers =
-        createFrameBuffers(device, vkSwapChainCreateInfo.imageExtent, swapchainImageViews, swapchainImages_count);
+        createFrameBuffers(device, vkSwapChainCreateInfo.imageExtent, scaled ? &resolution.view : swapchainImageViews,
+                           framebuffers_count, &attachments, &swapchainArena);
 
     // create command pools
     VkCommandPool commandPool = createCommandPool(device, queues);
     VkCommandBuffer buffer = createCommandBuffer(device, commandPool);
-    recordCommandBuffer(buffer, framebuffers[0], graphicsPipeline, vkSwapChainCreateInfo.imageExtent);
+
+    struct Capture capture;
+    if (options.capture_interval && !(vkSwapChainCreateInfo.imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT))
+    {
+        loge("Swapchain images can't be copied from, capture disabled");
+        options.capture_interval = 0;
+    }
+    if (!capture_init(&capture, device, &deviceInfo.memory, vkSwapChainCreateInfo.imageExtent,
+                      vkSwapChainCreateInfo.imageFormat, options.capture_interval, options.capture_dir,
+                      options.capture_format))
+    {
+        loge("failed to create frame capture!");
+        exit(1);
+    }
+
+    struct TextureManager textures;
+    if (!texture_manager_init(&textures, physicalDevice, device, &deviceInfo.memory,
+                              (VkDeviceSize)options.upload_budget_kb * 1024,
+                              (VkDeviceSize)options.texture_budget_mb * 1024 * 1024))
+    {
+        loge("failed to create texture manager!");
+        exit(1);
+    }
+    struct SpriteBatch sprites;
+    if (!sprite_batch_init(&sprites, device, &deviceInfo.memory, &textures, options.sprites, global.renderPass,
+                           pipelineTask.samples, pipelineCache, assets.spriteVertex, assets.spriteFrag))
+    {
+        loge("failed to create sprite batch!");
+        exit(1);
+    }
+    // the simulation thread starts once the deferred texture loads are done
+    struct DemoScene demoScene = {
+        .textures = &textures, .sprites = options.sprites, .extent = vkSwapChainCreateInfo.imageExtent};
+    struct Scene scene;
+    if (!scene_init(&scene, options.sprites, options.sim_hz, demo_scene_step, &demoScene))
+    {
+        loge("failed to create scene!");
+        exit(1);
+    }
+    free(assets.vertex.ptr);
+    free(assets.frag.ptr);
+    free(assets.particleCompute.ptr);
+    free(assets.particleVertex.ptr);
+    free(assets.spriteVertex.ptr);
+    free(assets.spriteFrag.ptr);
 
     VkFence inFlightFence = createFence(device);                   // signaled when frame presentation is finished
     VkSemaphore imageAvailableSemaphore = createSemaphore(device); // signaled when image aquired from swapchain
-    VkSemaphore renderFinishSemaphores[4] = {createSemaphore(device), createSemaphore(device), createSemaphore(device),
-                                             createSemaphore(device)};
-    while (!glfwWindowShouldClose(window))
+    // one per swapchain image, presentation of image i waits on renderFinishSemaphores[i]
+    VkSemaphore *renderFinishSemaphores = arena_alloc_array(&swapchainArena, VkSemaphore, swapchainImages_count);
+    for (uint32_t i = 0; i < swapchainImages_count; i++)
+    {
+        renderFinishSemaphores[i] = createSemaphore(device);
+    }
+
+    // nothing the first frame draws
+    startup_defer(&startup, "device_cache", save_device_cache_task, &instanceTask.devices.cache);
+    struct TextureLoad textureLoad = {.manager = &textures, .options = &options};
+    startup_defer(&startup, "textures", load_textures_task, &textureLoad);
+    startup_phase(&startup, NULL);
+    double startupMs = time_ms() - startTime;
+    logi("[bench] config=%s startup_ms=%.3f", BUILD_CONFIG, startupMs);
+
+    struct FrameStats frameStats = {0};
+    uint64_t frame = 0;
+    uint64_t hotPathAllocations = 0;
+    uint64_t framesWithAllocations = 0;
+    uint64_t streamingAllocations = 0;
+    uint64_t streamingFrames = 0;
+    double lastFrameTime = time_ms();
+    while (!glfwWindowShouldClose(window) && (options.max_frames == 0 || frame < options.max_frames))
     {
         glfwPollEvents();
+        uint64_t allocationsBefore = host_memory_allocation_count();
+        arena_reset(&frameArena);
         // draw
         vkWaitForFences(device, 1, &inFlightFence, VK_TRUE, UINT64_MAX);
         vkResetFences(device, 1, &inFlightFence);
+        if (frame > 0)
+        {
+            capture_frames_complete(&capture, frame - 1);
+        }
         uint32_t i;
         vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &i);
         vkResetCommandBuffer(buffer, 0);
-        recordCommandBuffer(buffer, framebuffers[i], graphicsPipeline, vkSwapChainCreateInfo.imageExtent);
+        beginCommandBuffer(buffer);
+        resolution_begin(&resolution, buffer);
+        int streamed = texture_stream_update(&textures, buffer, frame);
+        // the previous frame is done with the stream buffer and descriptor sets, and after the streaming
+        // update the descriptor sets pick up every view that changed this frame
+        const struct FramePacket *packet = scene_acquire(&scene);
+        sprite_batch_begin(&sprites);
+        for (uint32_t s = 0; packet && s < packet->sprites_count; s++)
+        {
+            sprite_batch_add(&sprites, &packet->sprites[s]);
+        }
+        sprite_batch_end(&sprites, &frameArena);
+        // fixed step so runs are comparable
+        particles_simulate(&particles, buffer, 1.0f / 60.0f);
+        recordCommandBuffer(buffer, framebuffers[scaled ? 0 : i], graphicsPipeline, resolution.extent,
+                            vkSwapChainCreateInfo.imageExtent, &particles, &sprites);
+        resolution_end(&resolution, buffer, swapchainImages[i], vkSwapChainCreateInfo.imageExtent);
+        capture_record(&capture, buffer, swapchainImages[i], frame);
+        endCommandBuffer(buffer);
         VkPipelineStageFlags stages[1] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
         VkSubmitInfo submitInfo = {.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
                                    .waitSemaphoreCount = 1,
@@ -890,28 +1263,109 @@ int main()
             .pImageIndices = &i,
         };
         vkQueuePresentKHR(presentQueue, &presentInfo);
+
+        // the first frames may still warm up driver caches, after that this should stay at 0. Frames that
+        // stream textures create images and memory objects, the driver allocates for those, so they are
+        // counted on their own.
+        uint64_t frameAllocations = host_memory_allocation_count() - allocationsBefore;
+        if (streamed)
+        {
+            streamingAllocations += frameAllocations;
+            streamingFrames++;
+        }
+        else if (frame > 0 && frameAllocations)
+        {
+            hotPathAllocations += frameAllocations;
+            framesWithAllocations++;
+        }
+
+        double now = time_ms();
+        if (frame == 0)
+        {
+            logi("[bench] config=%s first_frame_ms=%.3f", BUILD_CONFIG, now - startTime);
+            // the first frame is on screen, do what it didn't need
+            startup_run_deferred(&startup);
+            startup_report(&startup);
+            scene_start(&scene);
+            now = time_ms();
+        }
+        else
+        {
+            frame_stats_add(&frameStats, now - lastFrameTime);
+        }
+        lastFrameTime = now;
+        frame++;
+#ifdef ENABLE_PROFILING
+        if (frame % 1000 == 0)
+        {
+            logi("frame %llu: avg %.3f ms, min %.3f ms, max %.3f ms", (unsigned long long)frame,
+                 frame_stats_avg(&frameStats), frameStats.min_ms, frameStats.max_ms);
+        }
+#endif
     }
+    scene_stop(&scene);
     vkDeviceWaitIdle(device);
+    if (frame == 0)
+    {
+        startup_run_deferred(&startup);
+    }
+    if (frame > 0)
+    {
+        capture_frames_complete(&capture, frame - 1);
+    }
+    capture_destroy(&capture);
+    scene_report(&scene);
+    scene_destroy(&scene);
+    sprite_batch_report(&sprites);
+    sprite_batch_destroy(&sprites);
+    texture_report(&textures);
+    texture_manager_destroy(&textures);
+    particles_report(&particles);
+    particles_destroy(&particles);
+    attachments_report(&attachments);
+    resolution_report(&resolution);
+    frame_stats_report("frame_time", &frameStats);
+    logi("[bench] host_memory hot_path_allocs=%llu frames_with_allocs=%llu streaming_allocs=%llu "
+         "streaming_frames=%llu",
+         (unsigned long long)hotPathAllocations, (unsigned long long)framesWithAllocations,
+         (unsigned long long)streamingAllocations, (unsigned long long)streamingFrames);
+    host_memory_report();
+    arena_report(&swapchainArena);
+    arena_report(&frameArena);
     // cleanup
-    vkDestroySemaphore(device, imageAvailableSemaphore, NULL);
-    vkDestroyFence(device, inFlightFence, NULL);
-    vkDestroyCommandPool(device, commandPool, NULL);
-    vkDestroyPipeline(device, graphicsPipeline, NULL);
+    vkDestroySemaphore(device, imageAvailableSemaphore, host_vk_allocator());
+    vkDestroyFence(device, inFlightFence, host_vk_allocator());
+    vkDestroyCommandPool(device, commandPool, host_vk_allocator());
+    vkDestroyPipeline(device, graphicsPipeline, host_vk_allocator());
+    pipeline_cache_save(device, pipelineCache, PIPELINE_CACHE_FILE);
+    vkDestroyPipelineCache(device, pipelineCache, host_vk_allocator());
+    for (uint32_t i = 0; i < framebuffers_count; i++)
+    {
+        vkDestroyFramebuffer(device, framebuffers[i], host_vk_allocator());
+    }
     for (uint32_t i = 0; i < swapchainImages_count; i++)
     {
-        vkDestroyFramebuffer(device, framebuffers[i], NULL);
-        vkDestroyImageView(device, swapchainImageViews[i], NULL);
-        vkDestroySemaphore(device, renderFinishSemaphores[i], NULL);
-    }
-    vkDestroyRenderPass(device, global.renderPass, NULL);
-    vkDestroyPipelineLayout(device, global.pipelineLayout, NULL);
-    vkDestroySwapchainKHR(device, swapchain, NULL);
-    vkDestroyDevice(device, 0);
-    DestroyDebugUtilsMessengerEXT(instance, debugMessenger, NULL);
-    vkDestroySurfaceKHR(instance, surface, 0);
-    vkDestroyInstance(instance, NULL);
+        vkDestroyImageView(device, swapchainImageViews[i], host_vk_allocator());
+        vkDestroySemaphore(device, renderFinishSemaphores[i], host_vk_allocator());
+    }
+    resolution_destroy(&resolution);
+    attachments_destroy(&attachments);
+    vkDestroyRenderPass(device, global.renderPass, host_vk_allocator());
+    vkDestroyPipelineLayout(device, global.pipelineLayout, host_vk_allocator());
+    vkDestroySwapchainKHR(device, swapchain, host_vk_allocator());
+    vkDestroyDevice(device, host_vk_allocator());
+    if (debugMessenger != VK_NULL_HANDLE)
+    {
+        DestroyDebugUtilsMessengerEXT(instance, debugMessenger, host_vk_allocator());
+    }
+    vkDestroySurfaceKHR(instance, surface, host_vk_allocator());
+    vkDestroyInstance(instance, host_vk_allocator());
     glfwDestroyWindow(window);
     glfwTerminate();
+    arena_destroy(&frameArena);
+    arena_destroy(&swapchainArena);
+    host_memory_shutdown();
+    startup_destroy(&startup);
 
     return 0;
 }
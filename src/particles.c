@@ -0,0 +1,402 @@
+#include "particles.h"
+
+#include <string.h>
+
+#include "clib/log.h"
+#include "host_memory.h"
+
+#define PARTICLES_WORKGROUP_SIZE 256 // local_size_x in particles.comp
+
+enum
+{
+    QUERY_SIM_BEGIN,
+    QUERY_SIM_END,
+    QUERY_DRAW_BEGIN,
+    QUERY_DRAW_END,
+    QUERY_COUNT,
+};
+
+// matches the push constant block in particles.comp
+struct ParticleParams
+{
+    uint32_t count;
+    uint32_t seed;
+    float dt;
+    float time;
+};
+
+static int create_descriptors(struct Particles *particles)
+{
+    VkDevice device = particles->device;
+    VkDescriptorSetLayoutBinding bindings[4];
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        bindings[i] = (VkDescriptorSetLayoutBinding){.binding = i,
+                                                     .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                                     .descriptorCount = 1,
+                                                     .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT};
+    }
+    VkDescriptorSetLayoutCreateInfo layoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 4, .pBindings = bindings};
+    if (vkCreateDescriptorSetLayout(device, &layoutInfo, host_vk_allocator(), &particles->setLayout) != VK_SUCCESS)
+    {
+        loge("failed to create particle descriptor set layout!");
+        return 0;
+    }
+    VkDescriptorPoolSize poolSize = {.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, .descriptorCount = 8};
+    VkDescriptorPoolCreateInfo poolInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                                           .maxSets = 2,
+                                           .poolSizeCount = 1,
+                                           .pPoolSizes = &poolSize};
+    if (vkCreateDescriptorPool(device, &poolInfo, host_vk_allocator(), &particles->descriptorPool) != VK_SUCCESS)
+    {
+        loge("failed to create particle descriptor pool!");
+        return 0;
+    }
+    VkDescriptorSetLayout layouts[2] = {particles->setLayout, particles->setLayout};
+    VkDescriptorSetAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                                             .descriptorPool = particles->descriptorPool,
+                                             .descriptorSetCount = 2,
+                                             .pSetLayouts = layouts};
+    if (vkAllocateDescriptorSets(device, &allocInfo, particles->sets) != VK_SUCCESS)
+    {
+        loge("failed to allocate particle descriptor sets!");
+        return 0;
+    }
+    for (uint32_t set = 0; set < 2; set++)
+    {
+        uint32_t in = set;
+        uint32_t out = 1 - set;
+        VkDescriptorBufferInfo buffers[4] = {
+            {particles->positions[in], 0, VK_WHOLE_SIZE},
+            {particles->velocities[in], 0, VK_WHOLE_SIZE},
+            {particles->positions[out], 0, VK_WHOLE_SIZE},
+            {particles->velocities[out], 0, VK_WHOLE_SIZE},
+        };
+        VkWriteDescriptorSet write = {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                      .dstSet = particles->sets[set],
+                                      .dstBinding = 0,
+                                      .dstArrayElement = 0,
+                                      .descriptorCount = 4,
+                                      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                      .pBufferInfo = buffers};
+        vkUpdateDescriptorSets(device, 1, &write, 0, NULL);
+    }
+    return 1;
+}
+
+static int create_compute(struct Particles *particles, VkPipelineCache pipelineCache, code compute)
+{
+    VkPushConstantRange range = {
+        .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(struct ParticleParams)};
+    VkPipelineLayoutCreateInfo layoutInfo = {.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                                             .setLayoutCount = 1,
+                                             .pSetLayouts = &particles->setLayout,
+                                             .pushConstantRangeCount = 1,
+                                             .pPushConstantRanges = &range};
+    if (vkCreatePipelineLayout(particles->device, &layoutInfo, host_vk_allocator(), &particles->computeLayout) !=
+        VK_SUCCESS)
+    {
+        loge("failed to create particle pipeline layout!");
+        return 0;
+    }
+    particles->computePipeline = createComputePipeline(particles->device, pipelineCache, particles->computeLayout,
+                                                       compute);
+    return particles->computePipeline != VK_NULL_HANDLE;
+}
+
+static int create_draw(struct Particles *particles, VkRenderPass renderPass, VkSampleCountFlagBits samples,
+                       VkPipelineCache pipelineCache, code vertex, code fragment)
+{
+    VkDevice device = particles->device;
+    VkShaderModule vertexModule = createShaderModule(device, vertex);
+    VkShaderModule fragModule = createShaderModule(device, fragment);
+    VkPipelineShaderStageCreateInfo shaderStages[2] = {
+        {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+         .stage = VK_SHADER_STAGE_VERTEX_BIT,
+         .module = vertexModule,
+         .pName = "main"},
+        {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+         .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+         .module = fragModule,
+         .pName = "main"},
+    };
+
+    // one stream per attribute, straight out of the storage buffers
+    VkVertexInputBindingDescription vertexBindings[2] = {
+        {.binding = 0, .stride = 2 * sizeof(float), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX},
+        {.binding = 1, .stride = 2 * sizeof(float), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX},
+    };
+    VkVertexInputAttributeDescription vertexAttributes[2] = {
+        {.location = 0, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = 0},
+        {.location = 1, .binding = 1, .format = VK_FORMAT_R32G32_SFLOAT, .offset = 0},
+    };
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = 2,
+        .pVertexBindingDescriptions = vertexBindings,
+        .vertexAttributeDescriptionCount = 2,
+        .pVertexAttributeDescriptions = vertexAttributes};
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST,
+        .primitiveRestartEnable = VK_FALSE};
+    VkDynamicState dynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState = {.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+                                                     .dynamicStateCount = 2,
+                                                     .pDynamicStates = dynamicStates};
+    VkPipelineViewportStateCreateInfo viewportState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO, .viewportCount = 1, .scissorCount = 1};
+    VkPipelineRasterizationStateCreateInfo rasterizer = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .lineWidth = 1.0f,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_CLOCKWISE};
+    VkPipelineMultisampleStateCreateInfo multisampling = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = samples,
+        .minSampleShading = 1.0f};
+    // hidden behind opaque geometry, but points don't occlude each other
+    VkPipelineDepthStencilStateCreateInfo depthStencil = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = VK_FALSE,
+        .depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL};
+    // additive, dense regions glow
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+        .blendEnable = VK_TRUE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+        .colorWriteMask =
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT};
+    VkPipelineColorBlendStateCreateInfo colorBlending = {.sType =
+                                                             VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+                                                         .logicOpEnable = VK_FALSE,
+                                                         .attachmentCount = 1,
+                                                         .pAttachments = &colorBlendAttachment};
+
+    VkPipelineLayoutCreateInfo layoutInfo = {.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+    if (vkCreatePipelineLayout(device, &layoutInfo, host_vk_allocator(), &particles->drawLayout) != VK_SUCCESS)
+    {
+        loge("failed to create particle draw layout!");
+    }
+    VkGraphicsPipelineCreateInfo pipelineInfo = {.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                                                 .stageCount = 2,
+                                                 .pStages = shaderStages,
+                                                 .pVertexInputState = &vertexInputInfo,
+                                                 .pInputAssemblyState = &inputAssembly,
+                                                 .pViewportState = &viewportState,
+                                                 .pRasterizationState = &rasterizer,
+                                                 .pMultisampleState = &multisampling,
+                                                 .pDepthStencilState = &depthStencil,
+                                                 .pColorBlendState = &colorBlending,
+                                                 .pDynamicState = &dynamicState,
+                                                 .layout = particles->drawLayout,
+                                                 .renderPass = renderPass,
+                                                 .subpass = 0,
+                                                 .basePipelineHandle = VK_NULL_HANDLE};
+    if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, host_vk_allocator(),
+                                  &particles->drawPipeline) != VK_SUCCESS)
+    {
+        loge("failed to create particle draw pipeline!");
+        particles->drawPipeline = VK_NULL_HANDLE;
+    }
+    vkDestroyShaderModule(device, fragModule, host_vk_allocator());
+    vkDestroyShaderModule(device, vertexModule, host_vk_allocator());
+    return particles->drawPipeline != VK_NULL_HANDLE;
+}
+
+static void create_queries(struct Particles *particles, VkPhysicalDevice physicalDevice, const struct DeviceInfo *info)
+{
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, NULL);
+    VkQueueFamilyProperties families[familyCount];
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families);
+    uint32_t validBits = families[info->queues.graphics].timestampValidBits;
+    if (validBits == 0)
+    {
+        logw("No timestamps on the graphics queue, particle timings disabled");
+        return;
+    }
+    particles->timestampMask = validBits >= 64 ? UINT64_MAX : ((uint64_t)1 << validBits) - 1;
+    particles->timestampPeriod = info->properties.limits.timestampPeriod;
+    VkQueryPoolCreateInfo queryInfo = {.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                                       .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                                       .queryCount = QUERY_COUNT};
+    if (vkCreateQueryPool(particles->device, &queryInfo, host_vk_allocator(), &particles->queries) != VK_SUCCESS)
+    {
+        logw("failed to create particle query pool!");
+        particles->queries = VK_NULL_HANDLE;
+    }
+}
+
+int particles_init(struct Particles *particles, VkPhysicalDevice physicalDevice, VkDevice device,
+                   const struct DeviceInfo *info, uint32_t count, VkRenderPass renderPass,
+                   VkSampleCountFlagBits samples, VkPipelineCache pipelineCache, code compute, code vertex,
+                   code fragment)
+{
+    memset(particles, 0, sizeof(*particles));
+    particles->device = device;
+    if (count == 0)
+    {
+        return 1;
+    }
+
+    VkDeviceSize size = (VkDeviceSize)count * 2 * sizeof(float);
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        if (!create_buffer(device, &info->memory, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &particles->positions[i],
+                           &particles->positionsMemory[i], NULL) ||
+            !create_buffer(device, &info->memory, size, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &particles->velocities[i],
+                           &particles->velocitiesMemory[i], NULL))
+        {
+            loge("Not enough device memory for %u particles", count);
+            particles_destroy(particles);
+            return 0;
+        }
+    }
+    particles->count = count;
+    if (!create_descriptors(particles) || !create_compute(particles, pipelineCache, compute) ||
+        !create_draw(particles, renderPass, samples, pipelineCache, vertex, fragment))
+    {
+        particles_destroy(particles);
+        return 0;
+    }
+    create_queries(particles, physicalDevice, info);
+    logi("%u particles, %.1f MiB of state", count, (double)(size * 4) / (1024.0 * 1024.0));
+    return 1;
+}
+
+static void collect_timings(struct Particles *particles)
+{
+    uint64_t ticks[QUERY_COUNT];
+    if (!particles->queriesPending ||
+        vkGetQueryPoolResults(particles->device, particles->queries, 0, QUERY_COUNT, sizeof(ticks), ticks,
+                              sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+    {
+        return;
+    }
+    particles->queriesPending = 0;
+    double toMs = particles->timestampPeriod / 1000000.0;
+    uint64_t mask = particles->timestampMask;
+    frame_stats_add(&particles->simStats,
+                    (double)((ticks[QUERY_SIM_END] - ticks[QUERY_SIM_BEGIN]) & mask) * toMs);
+    frame_stats_add(&particles->drawStats,
+                    (double)((ticks[QUERY_DRAW_END] - ticks[QUERY_DRAW_BEGIN]) & mask) * toMs);
+}
+
+void particles_simulate(struct Particles *particles, VkCommandBuffer buffer, float dt)
+{
+    if (particles->count == 0)
+    {
+        return;
+    }
+    collect_timings(particles);
+    if (particles->queries != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(buffer, particles->queries, 0, QUERY_COUNT);
+        vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, particles->queries, QUERY_SIM_BEGIN);
+    }
+
+    // the buffers about to be written were drawn from and the ones about to be
+    // read were written by the last frame
+    VkMemoryBarrier before = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                              .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                              .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT};
+    vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &before, 0, NULL, 0, NULL);
+
+    struct ParticleParams params = {
+        .count = particles->count, .seed = particles->initialized ? 0 : 0x9e3779b9u, .dt = dt, .time = particles->time};
+    vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particles->computePipeline);
+    vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, particles->computeLayout, 0, 1,
+                            &particles->sets[particles->current], 0, NULL);
+    vkCmdPushConstants(buffer, particles->computeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    vkCmdDispatch(buffer, (particles->count + PARTICLES_WORKGROUP_SIZE - 1) / PARTICLES_WORKGROUP_SIZE, 1, 1);
+    particles->current = 1 - particles->current;
+    particles->initialized = 1;
+    particles->time += dt;
+
+    VkMemoryBarrier after = {.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                             .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                             .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT};
+    vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1,
+                         &after, 0, NULL, 0, NULL);
+    if (particles->queries != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, particles->queries, QUERY_SIM_END);
+    }
+}
+
+void particles_draw(struct Particles *particles, VkCommandBuffer buffer)
+{
+    if (particles->count == 0 || !particles->initialized)
+    {
+        return;
+    }
+    if (particles->queries != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, particles->queries, QUERY_DRAW_BEGIN);
+    }
+    VkBuffer vertexBuffers[2] = {particles->positions[particles->current], particles->velocities[particles->current]};
+    VkDeviceSize offsets[2] = {0, 0};
+    vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, particles->drawPipeline);
+    vkCmdBindVertexBuffers(buffer, 0, 2, vertexBuffers, offsets);
+    vkCmdDraw(buffer, particles->count, 1, 0, 0);
+    if (particles->queries != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, particles->queries, QUERY_DRAW_END);
+        particles->queriesPending = 1;
+    }
+}
+
+void particles_report(const struct Particles *particles)
+{
+    if (particles->count == 0)
+    {
+        return;
+    }
+    double simMs = frame_stats_avg(&particles->simStats);
+    double drawMs = frame_stats_avg(&particles->drawStats);
+    logi("[bench] config=%s particles count=%u frames=%llu sim_avg_ms=%.4f sim_max_ms=%.4f draw_avg_ms=%.4f "
+         "draw_max_ms=%.4f mparticles_per_sim_ms=%.2f",
+         BUILD_CONFIG, particles->count, (unsigned long long)particles->simStats.count, simMs,
+         particles->simStats.max_ms, drawMs, particles->drawStats.max_ms,
+         simMs > 0.0 ? (double)particles->count / simMs / 1000000.0 : 0.0);
+}
+
+void particles_destroy(struct Particles *particles)
+{
+    VkDevice device = particles->device;
+    if (particles->queries != VK_NULL_HANDLE)
+        vkDestroyQueryPool(device, particles->queries, host_vk_allocator());
+    if (particles->drawPipeline != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, particles->drawPipeline, host_vk_allocator());
+    if (particles->drawLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, particles->drawLayout, host_vk_allocator());
+    if (particles->computePipeline != VK_NULL_HANDLE)
+        vkDestroyPipeline(device, particles->computePipeline, host_vk_allocator());
+    if (particles->computeLayout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, particles->computeLayout, host_vk_allocator());
+    if (particles->descriptorPool != VK_NULL_HANDLE)
+        vkDestroyDescriptorPool(device, particles->descriptorPool, host_vk_allocator());
+    if (particles->setLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, particles->setLayout, host_vk_allocator());
+    for (uint32_t i = 0; i < 2; i++)
+    {
+        if (particles->positions[i] != VK_NULL_HANDLE)
+            destroy_buffer(device, particles->positions[i], particles->positionsMemory[i]);
+        if (particles->velocities[i] != VK_NULL_HANDLE)
+            destroy_buffer(device, particles->velocities[i], particles->velocitiesMemory[i]);
+    }
+    memset(particles, 0, sizeof(*particles));
+    particles->device = device;
+}
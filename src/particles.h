@@ -0,0 +1,59 @@
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+#include "device.h"
+#include "timing.h"
+#include "vk_util.h"
+
+// GPU resident particle system. Positions and velocities live in separate
+// storage buffers (structure of arrays), twice: every step reads one set and
+// writes the other. The position/velocity buffers just written are bound as
+// vertex buffers to draw the particles as points, nothing is read back.
+struct Particles
+{
+    VkDevice device;
+    uint32_t count; // 0 = disabled, every call is a no-op
+    VkBuffer positions[2];
+    VkDeviceMemory positionsMemory[2];
+    VkBuffer velocities[2];
+    VkDeviceMemory velocitiesMemory[2];
+    uint32_t current; // buffers holding the latest state
+    int initialized;  // initial state written
+    float time;
+
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet sets[2]; // sets[i] reads buffers i and writes buffers 1 - i
+    VkPipelineLayout computeLayout;
+    VkPipeline computePipeline;
+    VkPipelineLayout drawLayout;
+    VkPipeline drawPipeline;
+
+    // simulation start/end, draw start/end; VK_NULL_HANDLE without timestamp support
+    VkQueryPool queries;
+    double timestampPeriod; // ns per tick
+    uint64_t timestampMask;
+    int queriesPending; // written last frame, not read yet
+    struct FrameStats simStats;
+    struct FrameStats drawStats;
+};
+
+// `count` 0 leaves the system disabled. The draw pipeline is built for
+// `renderPass` subpass 0 with `samples` and dynamic viewport and scissor.
+int particles_init(struct Particles *particles, VkPhysicalDevice physicalDevice, VkDevice device,
+                   const struct DeviceInfo *info, uint32_t count, VkRenderPass renderPass,
+                   VkSampleCountFlagBits samples, VkPipelineCache pipelineCache, code compute, code vertex,
+                   code fragment);
+// records one simulation step, outside of a render pass. Call once per frame
+// after the previous frame's fence was waited on, it collects its timings.
+void particles_simulate(struct Particles *particles, VkCommandBuffer buffer, float dt);
+// draws the latest state, inside the render pass
+void particles_draw(struct Particles *particles, VkCommandBuffer buffer);
+void particles_report(const struct Particles *particles);
+// device has to be idle
+void particles_destroy(struct Particles *particles);
+
+#endif
@@ -0,0 +1,98 @@
+#include "pipeline_cache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clib/log.h"
+#include "host_memory.h"
+
+void pipeline_cache_read(const char *path, struct PipelineCacheData *data)
+{
+    data->data = NULL;
+    data->size = 0;
+    FILE *file = fopen(path, "rb");
+    if (!file)
+    {
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    if (size > 0)
+    {
+        data->data = malloc(size);
+        if (data->data && fread(data->data, 1, size, file) == (size_t)size)
+        {
+            data->size = size;
+        }
+        else
+        {
+            free(data->data);
+            data->data = NULL;
+        }
+    }
+    fclose(file);
+}
+
+static int header_matches(const VkPhysicalDeviceProperties *properties, const struct PipelineCacheData *data)
+{
+    VkPipelineCacheHeaderVersionOne header;
+    if (data->size < sizeof(header))
+    {
+        return 0;
+    }
+    memcpy(&header, data->data, sizeof(header));
+    return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == properties->vendorID && header.deviceID == properties->deviceID &&
+           memcmp(header.pipelineCacheUUID, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+VkPipelineCache pipeline_cache_create(VkDevice device, const VkPhysicalDeviceProperties *properties,
+                                      struct PipelineCacheData *data)
+{
+    VkPipelineCacheCreateInfo createInfo = {.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+    if (header_matches(properties, data))
+    {
+        createInfo.initialDataSize = data->size;
+        createInfo.pInitialData = data->data;
+        logi("Using %zu bytes of %s", data->size, PIPELINE_CACHE_FILE);
+    }
+    else if (data->size)
+    {
+        logw("Ignoring %s made by another device or driver", PIPELINE_CACHE_FILE);
+    }
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    if (vkCreatePipelineCache(device, &createInfo, host_vk_allocator(), &cache) != VK_SUCCESS)
+    {
+        loge("failed to create pipeline cache!");
+    }
+    free(data->data);
+    data->data = NULL;
+    data->size = 0;
+    return cache;
+}
+
+void pipeline_cache_save(VkDevice device, VkPipelineCache cache, const char *path)
+{
+    size_t size = 0;
+    if (cache == VK_NULL_HANDLE || vkGetPipelineCacheData(device, cache, &size, NULL) != VK_SUCCESS || size == 0)
+    {
+        return;
+    }
+    void *data = malloc(size);
+    if (data && vkGetPipelineCacheData(device, cache, &size, data) == VK_SUCCESS)
+    {
+        FILE *file = fopen(path, "wb");
+        if (file)
+        {
+            fwrite(data, 1, size, file);
+            fclose(file);
+        }
+        else
+        {
+            logw("Could not write %s", path);
+        }
+    }
+    free(data);
+}
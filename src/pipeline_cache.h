@@ -0,0 +1,23 @@
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+#include <stddef.h>
+#include <vulkan/vulkan_core.h>
+
+#define PIPELINE_CACHE_FILE "pipeline_cache.bin"
+
+struct PipelineCacheData
+{
+    void *data;
+    size_t size;
+};
+
+// reads the file as is, no Vulkan calls so it can run before there is a device
+void pipeline_cache_read(const char *path, struct PipelineCacheData *data);
+// creates the cache from `data` if its header matches the device, an empty one
+// otherwise. Frees `data`.
+VkPipelineCache pipeline_cache_create(VkDevice device, const VkPhysicalDeviceProperties *properties,
+                                      struct PipelineCacheData *data);
+void pipeline_cache_save(VkDevice device, VkPipelineCache cache, const char *path);
+
+#endif
@@ -0,0 +1,286 @@
+#include "resolution.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "clib/log.h"
+#include "host_memory.h"
+#include "vk_util.h"
+
+#define QUERY_FRAME_BEGIN 0
+#define QUERY_FRAME_END 1
+#define QUERY_COUNT 2
+
+#define SMOOTHING 0.15f  // weight of the newest GPU time in the filtered one
+#define HYSTERESIS 0.03f // scale changes below this are ignored
+#define STEP 0.5f        // part of the way to the ideal scale taken per frame
+#define EXTENT_ALIGN 8   // rendered extent is a multiple of this
+
+int resolution_supported(VkPhysicalDevice physicalDevice, const VkSwapchainCreateInfoKHR *swapchain)
+{
+    if (!(swapchain->imageUsage & VK_IMAGE_USAGE_TRANSFER_DST_BIT))
+        return 0;
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, swapchain->imageFormat, &properties);
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT | VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+                                  VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                  VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & needed) == needed;
+}
+
+static uint32_t scaled_size(uint32_t size, float scale)
+{
+    uint32_t scaled = (uint32_t)((float)size * scale + EXTENT_ALIGN / 2) & ~(uint32_t)(EXTENT_ALIGN - 1);
+    if (scaled < EXTENT_ALIGN)
+        scaled = EXTENT_ALIGN;
+    return scaled < size ? scaled : size;
+}
+
+static void set_scale(struct Resolution *resolution, float scale)
+{
+    if (!resolution->scaled)
+        scale = 1.0f;
+    scale = scale < RESOLUTION_MIN_SCALE ? RESOLUTION_MIN_SCALE : (scale > 1.0f ? 1.0f : scale);
+    resolution->scale = scale;
+    resolution->extent = (VkExtent2D){scaled_size(resolution->maxExtent.width, scale),
+                                      scaled_size(resolution->maxExtent.height, scale)};
+}
+
+static int create_target(struct Resolution *resolution, const VkPhysicalDeviceMemoryProperties *memory)
+{
+    VkDevice device = resolution->device;
+    VkImageCreateInfo imageInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                   .imageType = VK_IMAGE_TYPE_2D,
+                                   .format = resolution->format,
+                                   .extent = {resolution->maxExtent.width, resolution->maxExtent.height, 1},
+                                   .mipLevels = 1,
+                                   .arrayLayers = 1,
+                                   .samples = VK_SAMPLE_COUNT_1_BIT,
+                                   .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                   .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                   .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                                   .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+    if (vkCreateImage(device, &imageInfo, host_vk_allocator(), &resolution->image) != VK_SUCCESS)
+    {
+        loge("failed to create render target!");
+        resolution->image = VK_NULL_HANDLE;
+        return 0;
+    }
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device, resolution->image, &requirements);
+    uint32_t type = find_memory_type(memory, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0);
+    VkMemoryAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                      .allocationSize = requirements.size,
+                                      .memoryTypeIndex = type};
+    if (type == UINT32_MAX ||
+        vkAllocateMemory(device, &allocInfo, host_vk_allocator(), &resolution->memory) != VK_SUCCESS)
+    {
+        loge("failed to allocate render target memory!");
+        resolution->memory = VK_NULL_HANDLE;
+        return 0;
+    }
+    vkBindImageMemory(device, resolution->image, resolution->memory, 0);
+    VkImageViewCreateInfo viewInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                                      .image = resolution->image,
+                                      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                                      .format = resolution->format,
+                                      .components = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+                                                     VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY},
+                                      .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                                           .baseMipLevel = 0,
+                                                           .levelCount = 1,
+                                                           .baseArrayLayer = 0,
+                                                           .layerCount = 1}};
+    if (vkCreateImageView(device, &viewInfo, host_vk_allocator(), &resolution->view) != VK_SUCCESS)
+    {
+        loge("failed to create render target view!");
+        resolution->view = VK_NULL_HANDLE;
+        return 0;
+    }
+    return 1;
+}
+
+static void create_queries(struct Resolution *resolution, VkPhysicalDevice physicalDevice,
+                           const struct DeviceInfo *info)
+{
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, NULL);
+    VkQueueFamilyProperties families[familyCount];
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families);
+    uint32_t validBits = families[info->queues.graphics].timestampValidBits;
+    if (validBits == 0)
+    {
+        if (resolution->budgetMs > 0.0)
+            logw("No timestamps on the graphics queue, render scale stays at %.2f", resolution->scale);
+        resolution->budgetMs = 0.0;
+        return;
+    }
+    resolution->timestampMask = validBits >= 64 ? UINT64_MAX : ((uint64_t)1 << validBits) - 1;
+    resolution->timestampPeriod = info->properties.limits.timestampPeriod;
+    VkQueryPoolCreateInfo queryInfo = {.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                                       .queryType = VK_QUERY_TYPE_TIMESTAMP,
+                                       .queryCount = QUERY_COUNT};
+    if (vkCreateQueryPool(resolution->device, &queryInfo, host_vk_allocator(), &resolution->queries) != VK_SUCCESS)
+    {
+        logw("failed to create frame query pool!");
+        resolution->queries = VK_NULL_HANDLE;
+        resolution->budgetMs = 0.0;
+    }
+}
+
+int resolution_init(struct Resolution *resolution, VkPhysicalDevice physicalDevice, VkDevice device,
+                    const struct DeviceInfo *info, int scaled, VkFormat format, VkExtent2D maxExtent, float scale,
+                    double budgetMs)
+{
+    memset(resolution, 0, sizeof(*resolution));
+    resolution->device = device;
+    resolution->scaled = scaled;
+    resolution->maxExtent = maxExtent;
+    resolution->format = format;
+    resolution->budgetMs = scaled ? budgetMs : 0.0;
+    set_scale(resolution, scale);
+    resolution->scaleMin = resolution->scale;
+    resolution->scaleMax = resolution->scale;
+    if (scaled && !create_target(resolution, &info->memory))
+    {
+        resolution_destroy(resolution);
+        return 0;
+    }
+    create_queries(resolution, physicalDevice, info);
+    if (scaled)
+    {
+        logi("Render target %ux%u, starting at %ux%u, %s", maxExtent.width, maxExtent.height,
+             resolution->extent.width, resolution->extent.height,
+             resolution->budgetMs > 0.0 ? "scaled to the GPU budget" : "fixed scale");
+    }
+    return 1;
+}
+
+// GPU time grows about linearly with the pixel count, so with the scale squared
+static void update_scale(struct Resolution *resolution, double gpuMs)
+{
+    resolution->filteredMs = resolution->filteredMs == 0.0
+                                 ? gpuMs
+                                 : resolution->filteredMs + (gpuMs - resolution->filteredMs) * SMOOTHING;
+    if (resolution->budgetMs <= 0.0 || resolution->filteredMs <= 0.0)
+        return;
+    float ideal = resolution->scale * (float)sqrt(resolution->budgetMs / resolution->filteredMs);
+    ideal = ideal < RESOLUTION_MIN_SCALE ? RESOLUTION_MIN_SCALE : (ideal > 1.0f ? 1.0f : ideal);
+    // don't chase noise, the resolution would visibly pump
+    if (fabsf(ideal - resolution->scale) < HYSTERESIS)
+        return;
+    VkExtent2D before = resolution->extent;
+    set_scale(resolution, resolution->scale + (ideal - resolution->scale) * STEP);
+    if (before.width != resolution->extent.width || before.height != resolution->extent.height)
+        resolution->changes++;
+}
+
+static void collect_timings(struct Resolution *resolution)
+{
+    uint64_t ticks[QUERY_COUNT];
+    if (!resolution->queriesPending ||
+        vkGetQueryPoolResults(resolution->device, resolution->queries, 0, QUERY_COUNT, sizeof(ticks), ticks,
+                              sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS)
+    {
+        return;
+    }
+    resolution->queriesPending = 0;
+    uint64_t mask = resolution->timestampMask;
+    double gpuMs = (double)((ticks[QUERY_FRAME_END] - ticks[QUERY_FRAME_BEGIN]) & mask) *
+                   resolution->timestampPeriod / 1000000.0;
+    frame_stats_add(&resolution->gpuStats, gpuMs);
+    update_scale(resolution, gpuMs);
+}
+
+void resolution_begin(struct Resolution *resolution, VkCommandBuffer buffer)
+{
+    collect_timings(resolution);
+    resolution->frames++;
+    resolution->scaleTotal += resolution->scale;
+    if (resolution->scale < resolution->scaleMin)
+        resolution->scaleMin = resolution->scale;
+    if (resolution->scale > resolution->scaleMax)
+        resolution->scaleMax = resolution->scale;
+    if (resolution->queries != VK_NULL_HANDLE)
+    {
+        vkCmdResetQueryPool(buffer, resolution->queries, 0, QUERY_COUNT);
+        vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, resolution->queries, QUERY_FRAME_BEGIN);
+    }
+}
+
+void resolution_end(struct Resolution *resolution, VkCommandBuffer buffer, VkImage image, VkExtent2D imageExtent)
+{
+    if (resolution->scaled)
+    {
+        VkImageSubresourceRange range = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                         .baseMipLevel = 0,
+                                         .levelCount = 1,
+                                         .baseArrayLayer = 0,
+                                         .layerCount = 1};
+        // the render pass' dependency to external already made the target readable by the blit, the
+        // swapchain image waits on the acquire semaphore through COLOR_ATTACHMENT_OUTPUT
+        VkImageMemoryBarrier before = {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                       .srcAccessMask = 0,
+                                       .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                       .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                                       .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                       .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                       .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                       .image = image,
+                                       .subresourceRange = range};
+        vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, NULL, 0, NULL, 1, &before);
+
+        VkImageBlit blit = {
+            .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            .srcOffsets = {{0, 0, 0}, {(int32_t)resolution->extent.width, (int32_t)resolution->extent.height, 1}},
+            .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+            .dstOffsets = {{0, 0, 0}, {(int32_t)imageExtent.width, (int32_t)imageExtent.height, 1}},
+        };
+        vkCmdBlitImage(buffer, resolution->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        // COLOR_ATTACHMENT_OUTPUT so a capture copy, which expects a rendered image, chains onto it
+        VkImageMemoryBarrier after = {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                                      .dstAccessMask = 0,
+                                      .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                      .newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                      .image = image,
+                                      .subresourceRange = range};
+        vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0,
+                             0, NULL, 0, NULL, 1, &after);
+    }
+    if (resolution->queries != VK_NULL_HANDLE)
+    {
+        vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, resolution->queries, QUERY_FRAME_END);
+        resolution->queriesPending = 1;
+    }
+}
+
+void resolution_report(const struct Resolution *resolution)
+{
+    logi("[bench] config=%s resolution scaled=%d budget_ms=%.2f gpu_avg_ms=%.3f gpu_min_ms=%.3f gpu_max_ms=%.3f "
+         "scale_avg=%.3f scale_min=%.3f scale_max=%.3f changes=%llu final=%ux%u",
+         BUILD_CONFIG, resolution->scaled, resolution->budgetMs, frame_stats_avg(&resolution->gpuStats),
+         resolution->gpuStats.min_ms, resolution->gpuStats.max_ms,
+         resolution->frames ? resolution->scaleTotal / (double)resolution->frames : (double)resolution->scale,
+         resolution->scaleMin, resolution->scaleMax, (unsigned long long)resolution->changes,
+         resolution->extent.width, resolution->extent.height);
+}
+
+void resolution_destroy(struct Resolution *resolution)
+{
+    VkDevice device = resolution->device;
+    if (resolution->queries != VK_NULL_HANDLE)
+        vkDestroyQueryPool(device, resolution->queries, host_vk_allocator());
+    if (resolution->view != VK_NULL_HANDLE)
+        vkDestroyImageView(device, resolution->view, host_vk_allocator());
+    if (resolution->image != VK_NULL_HANDLE)
+        vkDestroyImage(device, resolution->image, host_vk_allocator());
+    if (resolution->memory != VK_NULL_HANDLE)
+        vkFreeMemory(device, resolution->memory, host_vk_allocator());
+    memset(resolution, 0, sizeof(*resolution));
+}
@@ -0,0 +1,62 @@
+#ifndef RESOLUTION_H
+#define RESOLUTION_H
+
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+#include "device.h"
+#include "timing.h"
+
+#define RESOLUTION_MIN_SCALE 0.25f // of the swapchain extent, per axis
+
+// Renders into an internal target whose size is independent of the swapchain
+// and blits it up to the swapchain image. The whole frame is timed with GPU
+// timestamps and with a budget the render scale follows the measured time.
+// Without `scaled` nothing is blitted, the frame is only timed.
+struct Resolution
+{
+    VkDevice device;
+    int scaled;
+    VkExtent2D maxExtent; // internal target size, the swapchain extent
+    VkExtent2D extent;    // rendered part of the target this frame
+    float scale;
+    double budgetMs; // 0 = fixed scale
+
+    VkFormat format;
+    VkImage image;
+    VkImageView view;
+    VkDeviceMemory memory;
+
+    // frame start/end; VK_NULL_HANDLE without timestamp support
+    VkQueryPool queries;
+    double timestampPeriod; // ns per tick
+    uint64_t timestampMask;
+    int queriesPending;
+    double filteredMs;
+
+    struct FrameStats gpuStats;
+    uint64_t frames;
+    double scaleTotal;
+    float scaleMin;
+    float scaleMax;
+    uint64_t changes;
+};
+
+// whether the swapchain described by `swapchain` can be blitted to from an image of its format
+int resolution_supported(VkPhysicalDevice physicalDevice, const VkSwapchainCreateInfoKHR *swapchain);
+// `scaled` 0 only times frames. `scale` is the initial (or with `budgetMs` 0 the fixed) render scale.
+int resolution_init(struct Resolution *resolution, VkPhysicalDevice physicalDevice, VkDevice device,
+                    const struct DeviceInfo *info, int scaled, VkFormat format, VkExtent2D maxExtent, float scale,
+                    double budgetMs);
+// first thing in the command buffer, after the previous frame's fence was
+// waited on. Collects its time and picks this frame's extent.
+void resolution_begin(struct Resolution *resolution, VkCommandBuffer buffer);
+// after the render pass left the target in TRANSFER_SRC_OPTIMAL, with a
+// dependency to external that covers transfer reads. Leaves `image` in
+// PRESENT_SRC_KHR. Only records the end timestamp if not scaled.
+void resolution_end(struct Resolution *resolution, VkCommandBuffer buffer, VkImage image, VkExtent2D imageExtent);
+void resolution_report(const struct Resolution *resolution);
+// device has to be idle
+void resolution_destroy(struct Resolution *resolution);
+
+#endif
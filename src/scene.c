@@ -0,0 +1,172 @@
+#include "scene.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "clib/log.h"
+#include "timing.h"
+
+int scene_init(struct Scene *scene, uint32_t maxSprites, double hz, SceneStepFn step, void *arg)
+{
+    memset(scene, 0, sizeof(*scene));
+    atomic_init(&scene->head, 0);
+    atomic_init(&scene->tail, 0);
+    atomic_init(&scene->running, 0);
+    scene->periodMs = 1000.0 / (hz > 0.0 ? hz : 60.0);
+    scene->step = step;
+    scene->arg = arg;
+    for (uint32_t i = 0; i < SCENE_QUEUE_SIZE && maxSprites; i++)
+    {
+        scene->packets[i].sprites = malloc(sizeof(struct Sprite) * maxSprites);
+        if (!scene->packets[i].sprites)
+        {
+            loge("Not enough memory for %u sprites per frame packet", maxSprites);
+            scene_destroy(scene);
+            return 0;
+        }
+        scene->packets[i].sprites_capacity = maxSprites;
+    }
+    return 1;
+}
+
+static void sleep_until(double ms)
+{
+    struct timespec ts = {.tv_sec = (time_t)(ms / 1000.0)};
+    ts.tv_nsec = (long)((ms - (double)ts.tv_sec * 1000.0) * 1000000.0);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+    {
+        // interrupted by a signal
+    }
+}
+
+static void *scene_thread(void *arg)
+{
+    struct Scene *scene = arg;
+    uint64_t steps = 0;
+    double deadline = time_ms();
+    while (atomic_load_explicit(&scene->running, memory_order_relaxed))
+    {
+        uint64_t head = atomic_load_explicit(&scene->head, memory_order_relaxed);
+        uint64_t tail = atomic_load_explicit(&scene->tail, memory_order_acquire);
+        // fixed step: simulation time advances even if the packet is dropped
+        float time = (float)((double)steps * scene->periodMs / 1000.0);
+        steps++;
+        if (head - tail >= SCENE_QUEUE_SIZE)
+        {
+            scene->dropped++;
+        }
+        else
+        {
+            double start = time_ms();
+            struct FramePacket *packet = &scene->packets[head % SCENE_QUEUE_SIZE];
+            packet->sequence = head;
+            packet->time = time;
+            packet->dt = (float)(scene->periodMs / 1000.0);
+            packet->sprites_count = 0;
+            scene->step(packet, scene->arg);
+            packet->publishedMs = time_ms();
+            scene->stepMs += packet->publishedMs - start;
+            scene->published++;
+            atomic_store_explicit(&scene->head, head + 1, memory_order_release);
+        }
+
+        deadline += scene->periodMs;
+        double now = time_ms();
+        if (now > deadline)
+        {
+            // don't try to catch up, that would only make the next steps late too
+            scene->overruns++;
+            deadline = now;
+            continue;
+        }
+        sleep_until(deadline);
+    }
+    return NULL;
+}
+
+void scene_start(struct Scene *scene)
+{
+    atomic_store(&scene->running, 1);
+    if (pthread_create(&scene->thread, NULL, scene_thread, scene) != 0)
+    {
+        loge("Could not start the simulation thread");
+        atomic_store(&scene->running, 0);
+        return;
+    }
+    scene->started = 1;
+}
+
+void scene_stop(struct Scene *scene)
+{
+    if (!scene->started)
+    {
+        return;
+    }
+    atomic_store(&scene->running, 0);
+    pthread_join(scene->thread, NULL);
+    scene->started = 0;
+}
+
+const struct FramePacket *scene_acquire(struct Scene *scene)
+{
+    uint64_t head = atomic_load_explicit(&scene->head, memory_order_acquire);
+    uint64_t ready = head - scene->next;
+    scene->depthTotal += ready;
+    if (ready > scene->depthMax)
+        scene->depthMax = ready;
+    if (ready == 0)
+    {
+        if (scene->current)
+        {
+            scene->repeated++;
+            // a renderer faster than the simulation repeats packets by design, only one that aged past the
+            // period means the simulation fell behind
+            scene->late += time_ms() - scene->current->publishedMs > scene->periodMs;
+        }
+        return scene->current;
+    }
+    uint64_t newest = head - 1;
+    scene->skipped += ready - 1;
+    scene->next = head;
+    scene->current = &scene->packets[newest % SCENE_QUEUE_SIZE];
+    // frees the previously held packet and every skipped one
+    atomic_store_explicit(&scene->tail, newest, memory_order_release);
+    scene->acquired++;
+    double age = time_ms() - scene->current->publishedMs;
+    scene->latencyMs += age;
+    scene->late += age > scene->periodMs;
+    return scene->current;
+}
+
+int scene_add_sprite(struct FramePacket *packet, const struct Sprite *sprite)
+{
+    if (packet->sprites_count == packet->sprites_capacity)
+    {
+        return 0;
+    }
+    packet->sprites[packet->sprites_count++] = *sprite;
+    return 1;
+}
+
+void scene_report(const struct Scene *scene)
+{
+    uint64_t frames = scene->acquired + scene->repeated;
+    logi("[bench] config=%s scene sim_hz=%.1f published=%llu dropped=%llu overruns=%llu step_ms=%.4f "
+         "acquired=%llu skipped=%llu repeated=%llu late=%llu depth_avg=%.2f depth_max=%llu latency_ms=%.3f",
+         BUILD_CONFIG, 1000.0 / scene->periodMs, (unsigned long long)scene->published,
+         (unsigned long long)scene->dropped, (unsigned long long)scene->overruns,
+         scene->published ? scene->stepMs / scene->published : 0.0, (unsigned long long)scene->acquired,
+         (unsigned long long)scene->skipped, (unsigned long long)scene->repeated, (unsigned long long)scene->late,
+         frames ? (double)scene->depthTotal / frames : 0.0, (unsigned long long)scene->depthMax,
+         scene->acquired ? scene->latencyMs / scene->acquired : 0.0);
+}
+
+void scene_destroy(struct Scene *scene)
+{
+    scene_stop(scene);
+    for (uint32_t i = 0; i < SCENE_QUEUE_SIZE; i++)
+    {
+        free(scene->packets[i].sprites);
+        scene->packets[i].sprites = NULL;
+    }
+}
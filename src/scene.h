@@ -0,0 +1,81 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "sprite_batch.h"
+
+#define SCENE_QUEUE_SIZE 4 // packets, one is held by the render thread
+
+// Everything the render thread needs for one frame. Written by the simulation
+// thread, read only once it was published.
+struct FramePacket
+{
+    uint64_t sequence;
+    double publishedMs;
+    float time; // simulation time in seconds
+    float dt;   // since the previous packet
+    struct Sprite *sprites;
+    uint32_t sprites_count;
+    uint32_t sprites_capacity;
+};
+
+// fills `packet`, time and dt are already set
+typedef void (*SceneStepFn)(struct FramePacket *packet, void *arg);
+
+// Runs the simulation on its own thread at a fixed rate and hands frame
+// packets to the render thread through a lock-free single producer single
+// consumer ring. The render thread always takes the newest packet and keeps it
+// until it takes the next one, older unread packets are skipped, so the two
+// sides run at independent rates and a slow step never stretches a frame.
+// The simulation never overwrites unread packets: with the ring full (the
+// render thread stalled for SCENE_QUEUE_SIZE - 1 steps) it drops the step it
+// just ran, so after a stall the newest packet can be that many steps old.
+// Such frames show up as late.
+struct Scene
+{
+    struct FramePacket packets[SCENE_QUEUE_SIZE];
+    _Alignas(64) atomic_uint_fast64_t head; // next sequence the simulation writes
+    _Alignas(64) atomic_uint_fast64_t tail; // sequence the render thread holds, everything before is free
+
+    // simulation thread
+    pthread_t thread;
+    int started;
+    atomic_int running;
+    double periodMs;
+    SceneStepFn step;
+    void *arg;
+    uint64_t published;
+    uint64_t dropped;  // ring full, the render thread stopped taking packets
+    uint64_t overruns; // a step took longer than the period
+    double stepMs;
+
+    // render thread
+    uint64_t next; // first sequence not taken yet
+    const struct FramePacket *current;
+    uint64_t acquired;
+    uint64_t skipped;  // superseded by a newer packet before being rendered
+    uint64_t repeated; // frames without a new packet, the previous one is drawn again
+    uint64_t late;     // frames drawing a packet older than one simulation period
+    uint64_t depthTotal;
+    uint64_t depthMax;
+    double latencyMs; // published to taken, summed
+};
+
+// `maxSprites` per packet, `hz` steps per second
+int scene_init(struct Scene *scene, uint32_t maxSprites, double hz, SceneStepFn step, void *arg);
+// starts the simulation thread, everything `step` reads has to be safe to share from here on
+void scene_start(struct Scene *scene);
+void scene_stop(struct Scene *scene);
+// render thread: the newest packet, the previous one again if there is no new
+// one, NULL before the first. Valid until the next call.
+const struct FramePacket *scene_acquire(struct Scene *scene);
+// simulation thread, returns 0 if the packet is full
+int scene_add_sprite(struct FramePacket *packet, const struct Sprite *sprite);
+void scene_report(const struct Scene *scene);
+// stops the thread if it still runs
+void scene_destroy(struct Scene *scene);
+
+#endif
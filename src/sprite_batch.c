@@ -0,0 +1,550 @@
+#include "sprite_batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "clib/log.h"
+#include "timing.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// matches the vertex input of sprite.vert
+struct SpriteVertex
+{
+    float x, y;
+    uint32_t uv;    // R16G16_UNORM
+    uint32_t color; // R8G8B8A8_UNORM
+};
+
+struct SpritePushConstants
+{
+    float scale[2];
+    float offset[2];
+};
+
+#define KEY_LAYER_SHIFT 24
+#define KEY_PIPELINE_SHIFT 20
+#define KEY_STATE_MASK 0x00ffffffu // pipeline and texture
+
+static VkDeviceSize region_size(const struct SpriteBatch *batch)
+{
+    return (VkDeviceSize)batch->maxQuads * 4 * sizeof(struct SpriteVertex);
+}
+
+static int create_pipelines(struct SpriteBatch *batch, VkRenderPass renderPass, VkSampleCountFlagBits samples,
+                            VkPipelineCache pipelineCache, code vertex, code fragment)
+{
+    VkDevice device = batch->device;
+    VkShaderModule vertexModule = createShaderModule(device, vertex);
+    VkShaderModule fragModule = createShaderModule(device, fragment);
+    VkPipelineShaderStageCreateInfo shaderStages[2] = {
+        {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+         .stage = VK_SHADER_STAGE_VERTEX_BIT,
+         .module = vertexModule,
+         .pName = "main"},
+        {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+         .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
+         .module = fragModule,
+         .pName = "main"},
+    };
+    VkVertexInputBindingDescription vertexBinding = {
+        .binding = 0, .stride = sizeof(struct SpriteVertex), .inputRate = VK_VERTEX_INPUT_RATE_VERTEX};
+    VkVertexInputAttributeDescription vertexAttributes[3] = {
+        {.location = 0, .binding = 0, .format = VK_FORMAT_R32G32_SFLOAT, .offset = offsetof(struct SpriteVertex, x)},
+        {.location = 1, .binding = 0, .format = VK_FORMAT_R16G16_UNORM, .offset = offsetof(struct SpriteVertex, uv)},
+        {.location = 2,
+         .binding = 0,
+         .format = VK_FORMAT_R8G8B8A8_UNORM,
+         .offset = offsetof(struct SpriteVertex, color)},
+    };
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = 1,
+        .pVertexBindingDescriptions = &vertexBinding,
+        .vertexAttributeDescriptionCount = 3,
+        .pVertexAttributeDescriptions = vertexAttributes};
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE};
+    VkDynamicState dynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+    VkPipelineDynamicStateCreateInfo dynamicState = {.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+                                                     .dynamicStateCount = 2,
+                                                     .pDynamicStates = dynamicStates};
+    VkPipelineViewportStateCreateInfo viewportState = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO, .viewportCount = 1, .scissorCount = 1};
+    VkPipelineRasterizationStateCreateInfo rasterizer = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .lineWidth = 1.0f,
+        .cullMode = VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_CLOCKWISE};
+    VkPipelineMultisampleStateCreateInfo multisampling = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = samples,
+        .minSampleShading = 1.0f};
+    // overlays, drawn in layer order on top of everything
+    VkPipelineDepthStencilStateCreateInfo depthStencil = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_FALSE,
+        .depthWriteEnable = VK_FALSE};
+    VkPipelineColorBlendAttachmentState colorBlendAttachment = {
+        .blendEnable = VK_TRUE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+        .colorWriteMask =
+            VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT};
+    VkPipelineColorBlendStateCreateInfo colorBlending = {.sType =
+                                                             VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+                                                         .logicOpEnable = VK_FALSE,
+                                                         .attachmentCount = 1,
+                                                         .pAttachments = &colorBlendAttachment};
+    VkGraphicsPipelineCreateInfo pipelineInfo = {.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+                                                 .stageCount = 2,
+                                                 .pStages = shaderStages,
+                                                 .pVertexInputState = &vertexInputInfo,
+                                                 .pInputAssemblyState = &inputAssembly,
+                                                 .pViewportState = &viewportState,
+                                                 .pRasterizationState = &rasterizer,
+                                                 .pMultisampleState = &multisampling,
+                                                 .pDepthStencilState = &depthStencil,
+                                                 .pColorBlendState = &colorBlending,
+                                                 .pDynamicState = &dynamicState,
+                                                 .layout = batch->layout,
+                                                 .renderPass = renderPass,
+                                                 .subpass = 0,
+                                                 .basePipelineHandle = VK_NULL_HANDLE};
+    int ok = 1;
+    for (uint32_t p = 0; p < SPRITE_PIPELINE_COUNT && ok; p++)
+    {
+        colorBlendAttachment.dstColorBlendFactor =
+            p == SPRITE_PIPELINE_ADDITIVE ? VK_BLEND_FACTOR_ONE : VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, host_vk_allocator(),
+                                      &batch->pipelines[p]) != VK_SUCCESS)
+        {
+            loge("failed to create sprite pipeline!");
+            batch->pipelines[p] = VK_NULL_HANDLE;
+            ok = 0;
+        }
+    }
+    vkDestroyShaderModule(device, fragModule, host_vk_allocator());
+    vkDestroyShaderModule(device, vertexModule, host_vk_allocator());
+    return ok;
+}
+
+static int create_layout(struct SpriteBatch *batch)
+{
+    VkDevice device = batch->device;
+    VkDescriptorSetLayoutBinding binding = {.binding = 0,
+                                            .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                            .descriptorCount = 1,
+                                            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT};
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo = {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, .bindingCount = 1, .pBindings = &binding};
+    if (vkCreateDescriptorSetLayout(device, &setLayoutInfo, host_vk_allocator(), &batch->setLayout) != VK_SUCCESS)
+    {
+        loge("failed to create sprite descriptor set layout!");
+        return 0;
+    }
+    VkDescriptorPoolSize poolSize = {.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                     .descriptorCount = SPRITE_MAX_TEXTURES + 1};
+    VkDescriptorPoolCreateInfo poolInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+                                           .maxSets = SPRITE_MAX_TEXTURES + 1,
+                                           .poolSizeCount = 1,
+                                           .pPoolSizes = &poolSize};
+    if (vkCreateDescriptorPool(device, &poolInfo, host_vk_allocator(), &batch->descriptorPool) != VK_SUCCESS)
+    {
+        loge("failed to create sprite descriptor pool!");
+        return 0;
+    }
+    VkPushConstantRange range = {
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT, .offset = 0, .size = sizeof(struct SpritePushConstants)};
+    VkPipelineLayoutCreateInfo layoutInfo = {.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                                             .setLayoutCount = 1,
+                                             .pSetLayouts = &batch->setLayout,
+                                             .pushConstantRangeCount = 1,
+                                             .pPushConstantRanges = &range};
+    if (vkCreatePipelineLayout(device, &layoutInfo, host_vk_allocator(), &batch->layout) != VK_SUCCESS)
+    {
+        loge("failed to create sprite pipeline layout!");
+        return 0;
+    }
+    return 1;
+}
+
+static int create_buffers(struct SpriteBatch *batch, const VkPhysicalDeviceMemoryProperties *memory)
+{
+    VkDevice device = batch->device;
+    VkMemoryPropertyFlags flags;
+    // device local + host visible (resizable BAR) if there is such a type
+    if (!create_buffer(device, memory, region_size(batch) * SPRITE_STREAM_FRAMES, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &batch->stream,
+                       &batch->streamMemory, &flags))
+    {
+        return 0;
+    }
+    batch->streamCoherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    vkMapMemory(device, batch->streamMemory, 0, VK_WHOLE_SIZE, 0, (void **)&batch->streamMapped);
+
+    VkDeviceSize indicesSize = (VkDeviceSize)batch->maxQuads * 6 * sizeof(uint32_t);
+    if (!create_buffer(device, memory, indicesSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &batch->indices,
+                       &batch->indicesMemory, &flags))
+    {
+        return 0;
+    }
+    uint32_t *indices;
+    vkMapMemory(device, batch->indicesMemory, 0, VK_WHOLE_SIZE, 0, (void **)&indices);
+    for (uint32_t q = 0; q < batch->maxQuads; q++)
+    {
+        uint32_t v = q * 4;
+        uint32_t *out = indices + q * 6;
+        out[0] = v;
+        out[1] = v + 1;
+        out[2] = v + 2;
+        out[3] = v + 2;
+        out[4] = v + 3;
+        out[5] = v;
+    }
+    if (!(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+    {
+        VkMappedMemoryRange range = {.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+                                     .memory = batch->indicesMemory,
+                                     .offset = 0,
+                                     .size = VK_WHOLE_SIZE};
+        vkFlushMappedMemoryRanges(device, 1, &range);
+    }
+    vkUnmapMemory(device, batch->indicesMemory);
+    return 1;
+}
+
+int sprite_batch_init(struct SpriteBatch *batch, VkDevice device, const VkPhysicalDeviceMemoryProperties *memory,
+                      struct TextureManager *textures, uint32_t maxQuads, VkRenderPass renderPass,
+                      VkSampleCountFlagBits samples, VkPipelineCache pipelineCache, code vertex, code fragment)
+{
+    memset(batch, 0, sizeof(*batch));
+    batch->device = device;
+    batch->textures = textures;
+    batch->maxQuads = maxQuads;
+    if (maxQuads == 0)
+    {
+        return 1;
+    }
+    batch->sprites = malloc(sizeof(struct Sprite) * maxQuads);
+    if (!batch->sprites || !create_buffers(batch, memory) || !create_layout(batch) ||
+        !create_pipelines(batch, renderPass, samples, pipelineCache, vertex, fragment))
+    {
+        sprite_batch_destroy(batch);
+        return 0;
+    }
+    const uint8_t white[4] = {255, 255, 255, 255};
+    batch->white = texture_create(textures, "white", VK_FORMAT_R8G8B8A8_UNORM, 1, 1, white, sizeof(white));
+    return 1;
+}
+
+size_t sprite_batch_scratch_size(uint32_t maxQuads)
+{
+    // keys and order, twice for the radix sort, and at most one draw per quad
+    return (size_t)maxQuads * (4 * sizeof(uint32_t) + sizeof(struct SpriteDraw)) + 5 * _Alignof(struct SpriteDraw);
+}
+
+void sprite_batch_begin(struct SpriteBatch *batch)
+{
+    batch->sprites_count = 0;
+}
+
+void sprite_batch_add(struct SpriteBatch *batch, const struct Sprite *sprite)
+{
+    if (batch->sprites_count == batch->maxQuads)
+    {
+        batch->dropped += batch->maxQuads > 0;
+        return;
+    }
+    batch->sprites[batch->sprites_count++] = *sprite;
+}
+
+// Stable LSD radix sort of `values` by `keys`, one byte per pass. All four
+// histograms are built in a single pass and a pass is skipped when every key
+// has the same byte, which is common since layers and pipelines vary little.
+// Returns the buffer holding the sorted values, either `values` or `tmpValues`.
+static uint32_t *radix_sort(uint32_t *keys, uint32_t *values, uint32_t *tmpKeys, uint32_t *tmpValues,
+                            uint32_t count)
+{
+    uint32_t histograms[4][256];
+    memset(histograms, 0, sizeof(histograms));
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t key = keys[i];
+        histograms[0][key & 0xff]++;
+        histograms[1][(key >> 8) & 0xff]++;
+        histograms[2][(key >> 16) & 0xff]++;
+        histograms[3][key >> 24]++;
+    }
+    for (uint32_t pass = 0; pass < 4; pass++)
+    {
+        uint32_t shift = pass * 8;
+        uint32_t *histogram = histograms[pass];
+        if (count == 0 || histogram[(keys[0] >> shift) & 0xff] == count)
+            continue;
+        uint32_t sum = 0;
+        for (uint32_t b = 0; b < 256; b++)
+        {
+            uint32_t c = histogram[b];
+            histogram[b] = sum;
+            sum += c;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t dst = histogram[(keys[i] >> shift) & 0xff]++;
+            tmpKeys[dst] = keys[i];
+            tmpValues[dst] = values[i];
+        }
+        uint32_t *swap = keys;
+        keys = tmpKeys;
+        tmpKeys = swap;
+        swap = values;
+        values = tmpValues;
+        tmpValues = swap;
+    }
+    return values;
+}
+
+// the four corners of a quad in the order of the index pattern
+#if defined(__SSE2__)
+static void write_quad(struct SpriteVertex *out, const struct Sprite *s)
+{
+    const __m128 cornerX = _mm_setr_ps(0.0f, 1.0f, 1.0f, 0.0f);
+    const __m128 cornerY = _mm_setr_ps(0.0f, 0.0f, 1.0f, 1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 unorm16 = _mm_set1_ps(65535.0f);
+
+    __m128 x = _mm_add_ps(_mm_set1_ps(s->x), _mm_mul_ps(_mm_set1_ps(s->w), cornerX));
+    __m128 y = _mm_add_ps(_mm_set1_ps(s->y), _mm_mul_ps(_mm_set1_ps(s->h), cornerY));
+    __m128 u = _mm_add_ps(_mm_set1_ps(s->u0), _mm_mul_ps(_mm_set1_ps(s->u1 - s->u0), cornerX));
+    __m128 v = _mm_add_ps(_mm_set1_ps(s->v0), _mm_mul_ps(_mm_set1_ps(s->v1 - s->v0), cornerY));
+    u = _mm_mul_ps(_mm_min_ps(_mm_max_ps(u, zero), one), unorm16);
+    v = _mm_mul_ps(_mm_min_ps(_mm_max_ps(v, zero), one), unorm16);
+    __m128i uv = _mm_or_si128(_mm_cvtps_epi32(u), _mm_slli_epi32(_mm_cvtps_epi32(v), 16));
+    __m128 packedUv = _mm_castsi128_ps(uv);
+    __m128 color = _mm_castsi128_ps(_mm_set1_epi32((int)s->color));
+
+    // columns x, y, uv, color -> one vertex per register
+    _MM_TRANSPOSE4_PS(x, y, packedUv, color);
+    // the stream buffer is write combined, don't pull it into the cache
+    _mm_stream_ps((float *)&out[0], x);
+    _mm_stream_ps((float *)&out[1], y);
+    _mm_stream_ps((float *)&out[2], packedUv);
+    _mm_stream_ps((float *)&out[3], color);
+}
+#else
+static uint32_t pack_uv(float u, float v)
+{
+    u = u < 0.0f ? 0.0f : (u > 1.0f ? 1.0f : u);
+    v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+    return (uint32_t)(u * 65535.0f + 0.5f) | ((uint32_t)(v * 65535.0f + 0.5f) << 16);
+}
+
+static void write_quad(struct SpriteVertex *out, const struct Sprite *s)
+{
+    float x1 = s->x + s->w;
+    float y1 = s->y + s->h;
+    out[0] = (struct SpriteVertex){s->x, s->y, pack_uv(s->u0, s->v0), s->color};
+    out[1] = (struct SpriteVertex){x1, s->y, pack_uv(s->u1, s->v0), s->color};
+    out[2] = (struct SpriteVertex){x1, y1, pack_uv(s->u1, s->v1), s->color};
+    out[3] = (struct SpriteVertex){s->x, y1, pack_uv(s->u0, s->v1), s->color};
+}
+#endif
+
+// descriptor set of texture slot, (re)written when the texture's view changed
+static VkDescriptorSet texture_set(struct SpriteBatch *batch, uint32_t slot, const struct Texture *texture)
+{
+    if (batch->sets[slot] == VK_NULL_HANDLE)
+    {
+        VkDescriptorSetAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+                                                 .descriptorPool = batch->descriptorPool,
+                                                 .descriptorSetCount = 1,
+                                                 .pSetLayouts = &batch->setLayout};
+        if (vkAllocateDescriptorSets(batch->device, &allocInfo, &batch->sets[slot]) != VK_SUCCESS)
+        {
+            loge("failed to allocate sprite descriptor set!");
+            batch->sets[slot] = VK_NULL_HANDLE;
+            return VK_NULL_HANDLE;
+        }
+    }
+    if (batch->setGenerations[slot] != texture->viewGeneration)
+    {
+        VkDescriptorImageInfo imageInfo = {.sampler = batch->textures->sampler,
+                                           .imageView = texture->view,
+                                           .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        VkWriteDescriptorSet write = {.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                                      .dstSet = batch->sets[slot],
+                                      .dstBinding = 0,
+                                      .dstArrayElement = 0,
+                                      .descriptorCount = 1,
+                                      .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                      .pImageInfo = &imageInfo};
+        vkUpdateDescriptorSets(batch->device, 1, &write, 0, NULL);
+        batch->setGenerations[slot] = texture->viewGeneration;
+    }
+    return batch->sets[slot];
+}
+
+void sprite_batch_end(struct SpriteBatch *batch, struct HostArena *arena)
+{
+    uint32_t count = batch->sprites_count;
+    batch->draws_count = 0;
+    batch->quads = 0;
+    if (count == 0 || !batch->white || batch->white->view == VK_NULL_HANDLE)
+    {
+        return;
+    }
+    double start = time_ms();
+    uint32_t *keys = arena_alloc_array(arena, uint32_t, count);
+    uint32_t *order = arena_alloc_array(arena, uint32_t, count);
+    uint32_t *tmpKeys = arena_alloc_array(arena, uint32_t, count);
+    uint32_t *tmpOrder = arena_alloc_array(arena, uint32_t, count);
+    // slot 0 is white, textures without a resident level draw white until they stream in
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const struct Sprite *sprite = &batch->sprites[i];
+        uint32_t slot = 0;
+        if (sprite->texture)
+        {
+            texture_touch(batch->textures, sprite->texture);
+            if (sprite->texture->view != VK_NULL_HANDLE && sprite->texture->id < SPRITE_MAX_TEXTURES)
+                slot = sprite->texture->id + 1;
+        }
+        uint32_t pipeline = sprite->pipeline < SPRITE_PIPELINE_COUNT ? sprite->pipeline : SPRITE_PIPELINE_ALPHA;
+        keys[i] = ((uint32_t)sprite->layer << KEY_LAYER_SHIFT) | (pipeline << KEY_PIPELINE_SHIFT) | slot;
+        order[i] = i;
+    }
+    order = radix_sort(keys, order, tmpKeys, tmpOrder, count);
+    double sorted = time_ms();
+
+    // one draw per run of equal state, runs may span layers
+    struct SpriteDraw *draws = arena_alloc_array(arena, struct SpriteDraw, count);
+    struct SpriteVertex *vertices =
+        (struct SpriteVertex *)(batch->streamMapped + region_size(batch) * batch->region);
+    uint32_t state = UINT32_MAX;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const struct Sprite *sprite = &batch->sprites[order[i]];
+        uint32_t slot = sprite->texture && sprite->texture->view != VK_NULL_HANDLE &&
+                                sprite->texture->id < SPRITE_MAX_TEXTURES
+                            ? sprite->texture->id + 1
+                            : 0;
+        uint32_t pipeline = sprite->pipeline < SPRITE_PIPELINE_COUNT ? sprite->pipeline : SPRITE_PIPELINE_ALPHA;
+        uint32_t spriteState = (pipeline << KEY_PIPELINE_SHIFT) | slot;
+        if (spriteState != state)
+        {
+            state = spriteState;
+            draws[batch->draws_count++] =
+                (struct SpriteDraw){.pipeline = pipeline, .texture = slot, .firstQuad = i, .quadCount = 0};
+            texture_set(batch, slot, slot ? sprite->texture : batch->white);
+        }
+        draws[batch->draws_count - 1].quadCount++;
+        write_quad(&vertices[i * 4], sprite);
+    }
+#if defined(__SSE2__)
+    _mm_sfence();
+#endif
+    if (!batch->streamCoherent)
+    {
+        VkMappedMemoryRange range = {.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+                                     .memory = batch->streamMemory,
+                                     .offset = 0,
+                                     .size = VK_WHOLE_SIZE};
+        vkFlushMappedMemoryRanges(batch->device, 1, &range);
+    }
+    batch->draws = draws;
+    batch->quads = count;
+    double end = time_ms();
+
+    batch->frames++;
+    batch->totalQuads += count;
+    batch->totalDraws += batch->draws_count;
+    batch->sortMs += sorted - start;
+    batch->generateMs += end - sorted;
+}
+
+void sprite_batch_draw(struct SpriteBatch *batch, VkCommandBuffer buffer, VkExtent2D extent)
+{
+    if (batch->draws_count == 0)
+    {
+        return;
+    }
+    VkDeviceSize offset = region_size(batch) * batch->region;
+    vkCmdBindVertexBuffers(buffer, 0, 1, &batch->stream, &offset);
+    vkCmdBindIndexBuffer(buffer, batch->indices, 0, VK_INDEX_TYPE_UINT32);
+    // pixels -> normalized device coordinates, y points down in both
+    struct SpritePushConstants constants = {.scale = {2.0f / (float)extent.width, 2.0f / (float)extent.height},
+                                            .offset = {-1.0f, -1.0f}};
+    vkCmdPushConstants(buffer, batch->layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+    uint32_t pipeline = UINT32_MAX;
+    uint32_t texture = UINT32_MAX;
+    for (uint32_t d = 0; d < batch->draws_count; d++)
+    {
+        const struct SpriteDraw *draw = &batch->draws[d];
+        if (batch->sets[draw->texture] == VK_NULL_HANDLE)
+            continue;
+        if (draw->pipeline != pipeline)
+        {
+            pipeline = draw->pipeline;
+            vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, batch->pipelines[pipeline]);
+        }
+        if (draw->texture != texture)
+        {
+            texture = draw->texture;
+            vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, batch->layout, 0, 1,
+                                    &batch->sets[texture], 0, NULL);
+        }
+        vkCmdDrawIndexed(buffer, draw->quadCount * 6, 1, draw->firstQuad * 6, 0, 0);
+    }
+    batch->region = (batch->region + 1) % SPRITE_STREAM_FRAMES;
+}
+
+void sprite_batch_report(const struct SpriteBatch *batch)
+{
+    if (batch->frames == 0)
+    {
+        return;
+    }
+    double cpuMs = batch->sortMs + batch->generateMs;
+    logi("[bench] config=%s sprites frames=%llu quads_per_frame=%.0f draws_per_frame=%.2f sort_ms=%.4f "
+         "generate_ms=%.4f quads_per_ms=%.0f dropped=%llu",
+         BUILD_CONFIG, (unsigned long long)batch->frames, (double)batch->totalQuads / batch->frames,
+         (double)batch->totalDraws / batch->frames, batch->sortMs / batch->frames, batch->generateMs / batch->frames,
+         cpuMs > 0.0 ? (double)batch->totalQuads / cpuMs : 0.0, (unsigned long long)batch->dropped);
+}
+
+void sprite_batch_destroy(struct SpriteBatch *batch)
+{
+    VkDevice device = batch->device;
+    for (uint32_t p = 0; p < SPRITE_PIPELINE_COUNT; p++)
+    {
+        if (batch->pipelines[p] != VK_NULL_HANDLE)
+            vkDestroyPipeline(device, batch->pipelines[p], host_vk_allocator());
+    }
+    if (batch->layout != VK_NULL_HANDLE)
+        vkDestroyPipelineLayout(device, batch->layout, host_vk_allocator());
+    if (batch->descriptorPool != VK_NULL_HANDLE)
+        vkDestroyDescriptorPool(device, batch->descriptorPool, host_vk_allocator());
+    if (batch->setLayout != VK_NULL_HANDLE)
+        vkDestroyDescriptorSetLayout(device, batch->setLayout, host_vk_allocator());
+    if (batch->indices != VK_NULL_HANDLE)
+        destroy_buffer(device, batch->indices, batch->indicesMemory);
+    if (batch->stream != VK_NULL_HANDLE)
+    {
+        vkUnmapMemory(device, batch->streamMemory);
+        destroy_buffer(device, batch->stream, batch->streamMemory);
+    }
+    free(batch->sprites);
+    memset(batch, 0, sizeof(*batch));
+}
@@ -0,0 +1,101 @@
+#ifndef SPRITE_BATCH_H
+#define SPRITE_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+#include "host_memory.h"
+#include "texture.h"
+#include "vk_util.h"
+
+#define SPRITE_STREAM_FRAMES 2   // regions of the stream buffer, one is written while the other may be in use
+#define SPRITE_MAX_TEXTURES 1024 // texture ids at or above fall back to white
+
+enum SpritePipeline
+{
+    SPRITE_PIPELINE_ALPHA,
+    SPRITE_PIPELINE_ADDITIVE,
+    SPRITE_PIPELINE_COUNT,
+};
+
+struct Sprite
+{
+    float x, y, w, h;        // pixels, origin top left
+    float u0, v0, u1, v1;    // texture coordinates, 0..1
+    uint32_t color;          // R | G << 8 | B << 16 | A << 24, multiplied with the texture
+    uint8_t layer;           // drawn in increasing order, within a layer sprites are grouped by state
+    uint8_t pipeline;        // enum SpritePipeline
+    struct Texture *texture; // NULL = white
+};
+
+// what one vkCmdDrawIndexed draws
+struct SpriteDraw
+{
+    uint8_t pipeline;
+    uint32_t texture; // descriptor set index
+    uint32_t firstQuad;
+    uint32_t quadCount;
+};
+
+// Collects sprites for a frame, sorts them by layer, pipeline and texture
+// with a radix sort and writes their vertices into a persistently mapped
+// stream buffer, so the render pass only binds and draws runs of quads that
+// share the same state.
+struct SpriteBatch
+{
+    VkDevice device;
+    struct TextureManager *textures;
+    struct Texture *white;
+    uint32_t maxQuads; // 0 = disabled, every call is a no-op
+
+    struct Sprite *sprites; // submitted this frame
+    uint32_t sprites_count;
+
+    // SPRITE_STREAM_FRAMES regions of maxQuads * 4 vertices
+    VkBuffer stream;
+    VkDeviceMemory streamMemory;
+    uint8_t *streamMapped;
+    int streamCoherent;
+    uint32_t region;
+    VkBuffer indices; // static, 6 per quad
+    VkDeviceMemory indicesMemory;
+
+    VkDescriptorSetLayout setLayout;
+    VkDescriptorPool descriptorPool;
+    VkDescriptorSet sets[SPRITE_MAX_TEXTURES + 1]; // [0] = white, [id + 1] = texture id
+    uint32_t setGenerations[SPRITE_MAX_TEXTURES + 1];
+    VkPipelineLayout layout;
+    VkPipeline pipelines[SPRITE_PIPELINE_COUNT];
+
+    // prepared by sprite_batch_end, in the frame arena
+    struct SpriteDraw *draws;
+    uint32_t draws_count;
+    uint32_t quads;
+
+    uint64_t frames;
+    uint64_t totalQuads;
+    uint64_t totalDraws;
+    uint64_t dropped; // submitted past maxQuads
+    double sortMs;
+    double generateMs;
+};
+
+int sprite_batch_init(struct SpriteBatch *batch, VkDevice device, const VkPhysicalDeviceMemoryProperties *memory,
+                      struct TextureManager *textures, uint32_t maxQuads, VkRenderPass renderPass,
+                      VkSampleCountFlagBits samples, VkPipelineCache pipelineCache, code vertex, code fragment);
+// frame arena bytes sprite_batch_end needs at most
+size_t sprite_batch_scratch_size(uint32_t maxQuads);
+void sprite_batch_begin(struct SpriteBatch *batch);
+void sprite_batch_add(struct SpriteBatch *batch, const struct Sprite *sprite);
+// sorts and writes the vertices, outside of the render pass after the
+// previous frame's fence was waited on and after texture_stream_update, so the
+// descriptor sets see this frame's views. Scratch memory comes from `arena`.
+void sprite_batch_end(struct SpriteBatch *batch, struct HostArena *arena);
+// inside the render pass
+void sprite_batch_draw(struct SpriteBatch *batch, VkCommandBuffer buffer, VkExtent2D extent);
+void sprite_batch_report(const struct SpriteBatch *batch);
+// device has to be idle
+void sprite_batch_destroy(struct SpriteBatch *batch);
+
+#endif
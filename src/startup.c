@@ -0,0 +1,131 @@
+#include "startup.h"
+
+#include <string.h>
+
+#include "clib/log.h"
+#include "timing.h"
+
+static void add_phase(struct Startup *startup, const char *name, const char *thread, double start, double end)
+{
+    pthread_mutex_lock(&startup->lock);
+    if (startup->phases_count < STARTUP_MAX_PHASES)
+    {
+        startup->phases[startup->phases_count++] = (struct StartupPhase){
+            .name = name, .thread = thread, .start_ms = start - startup->origin, .ms = end - start};
+    }
+    pthread_mutex_unlock(&startup->lock);
+}
+
+void startup_init(struct Startup *startup, double origin, int serial)
+{
+    memset(startup, 0, sizeof(*startup));
+    startup->origin = origin;
+    startup->serial = serial;
+    pthread_mutex_init(&startup->lock, NULL);
+}
+
+void startup_phase(struct Startup *startup, const char *name)
+{
+    double now = time_ms();
+    if (startup->current)
+    {
+        add_phase(startup, startup->current, "main", startup->current_start, now);
+    }
+    startup->current = name;
+    startup->current_start = now;
+}
+
+static void *task_main(void *arg)
+{
+    struct StartupTask *task = arg;
+    double start = time_ms();
+    task->run(task->arg);
+    add_phase(task->startup, task->name, task->threaded ? "worker" : "main", start, time_ms());
+    return NULL;
+}
+
+void startup_spawn(struct Startup *startup, struct StartupTask *task, const char *name, void (*run)(void *),
+                   void *arg)
+{
+    *task = (struct StartupTask){.name = name, .run = run, .arg = arg, .startup = startup, .threaded = 1};
+    if (!startup->serial && pthread_create(&task->thread, NULL, task_main, task) == 0)
+    {
+        return;
+    }
+    // inline, as its own main thread phase
+    const char *resume = startup->current;
+    startup_phase(startup, NULL);
+    task->threaded = 0;
+    task_main(task);
+    startup_phase(startup, resume);
+}
+
+void startup_join(struct Startup *startup, struct StartupTask *task)
+{
+    startup_phase(startup, NULL);
+    if (!task->threaded)
+    {
+        return;
+    }
+    double start = time_ms();
+    pthread_join(task->thread, NULL);
+    add_phase(startup, task->name, "wait", start, time_ms());
+    task->threaded = 0;
+}
+
+void startup_defer(struct Startup *startup, const char *name, void (*run)(void *), void *arg)
+{
+    if (startup->deferred_count == STARTUP_MAX_DEFERRED)
+    {
+        logw("Too much deferred startup work, running %s now", name);
+        run(arg);
+        return;
+    }
+    startup->deferred[startup->deferred_count++] = (struct StartupDeferred){.name = name, .run = run, .arg = arg};
+}
+
+void startup_run_deferred(struct Startup *startup)
+{
+    startup->first_frame_ms = time_ms() - startup->origin;
+    for (uint32_t i = 0; i < startup->deferred_count; i++)
+    {
+        double start = time_ms();
+        startup->deferred[i].run(startup->deferred[i].arg);
+        add_phase(startup, startup->deferred[i].name, "deferred", start, time_ms());
+    }
+    startup->deferred_count = 0;
+}
+
+void startup_report(struct Startup *startup)
+{
+    double main_ms = 0.0;
+    double worker_ms = 0.0;
+    double wait_ms = 0.0;
+    double deferred_ms = 0.0;
+    pthread_mutex_lock(&startup->lock);
+    for (uint32_t i = 0; i < startup->phases_count; i++)
+    {
+        const struct StartupPhase *phase = &startup->phases[i];
+        logi("[bench] startup phase=%s thread=%s start_ms=%.3f ms=%.3f", phase->name, phase->thread, phase->start_ms,
+             phase->ms);
+        if (strcmp(phase->thread, "worker") == 0)
+            worker_ms += phase->ms;
+        else if (strcmp(phase->thread, "wait") == 0)
+            wait_ms += phase->ms;
+        else if (strcmp(phase->thread, "deferred") == 0)
+            deferred_ms += phase->ms;
+        else
+            main_ms += phase->ms;
+    }
+    pthread_mutex_unlock(&startup->lock);
+    // worker time the main thread did not wait for was hidden behind main thread work
+    logi("[bench] config=%s startup mode=%s main_ms=%.3f worker_ms=%.3f wait_ms=%.3f overlapped_ms=%.3f "
+         "deferred_ms=%.3f first_frame_ms=%.3f",
+         BUILD_CONFIG, startup->serial ? "serial" : "parallel", main_ms, worker_ms, wait_ms, worker_ms - wait_ms,
+         deferred_ms, startup->first_frame_ms);
+}
+
+void startup_destroy(struct Startup *startup)
+{
+    pthread_mutex_destroy(&startup->lock);
+}
@@ -0,0 +1,70 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define STARTUP_MAX_PHASES 32
+#define STARTUP_MAX_DEFERRED 8
+
+struct StartupPhase
+{
+    const char *name;
+    const char *thread; // "main", "worker", "wait" or "deferred"
+    double start_ms;    // relative to the start of the program
+    double ms;
+};
+
+struct StartupTask
+{
+    const char *name;
+    void (*run)(void *arg);
+    void *arg;
+    struct Startup *startup;
+    pthread_t thread;
+    int threaded; // 0 if it ran inline in startup_spawn
+};
+
+struct StartupDeferred
+{
+    const char *name;
+    void (*run)(void *arg);
+    void *arg;
+};
+
+// Times the steps between program start and the first frame. The main thread
+// moves from phase to phase with startup_phase, independent work runs on
+// worker threads with startup_spawn/startup_join, and work the first frame
+// doesn't need is queued with startup_defer and run after the first present.
+struct Startup
+{
+    double origin;
+    int serial; // run spawned tasks inline, for comparing against the parallel startup
+
+    pthread_mutex_t lock; // phases are added from the workers too
+    struct StartupPhase phases[STARTUP_MAX_PHASES];
+    uint32_t phases_count;
+    const char *current; // open main thread phase
+    double current_start;
+
+    struct StartupDeferred deferred[STARTUP_MAX_DEFERRED];
+    uint32_t deferred_count;
+    double first_frame_ms;
+};
+
+void startup_init(struct Startup *startup, double origin, int serial);
+// ends the open main thread phase and opens `name`, NULL only ends it
+void startup_phase(struct Startup *startup, const char *name);
+// runs `run(arg)` on a new thread (inline if serial or the thread can't be created)
+void startup_spawn(struct Startup *startup, struct StartupTask *task, const char *name, void (*run)(void *),
+                   void *arg);
+// ends the open main thread phase and waits for the task, the time spent blocked is its own phase
+void startup_join(struct Startup *startup, struct StartupTask *task);
+void startup_defer(struct Startup *startup, const char *name, void (*run)(void *), void *arg);
+// call right after the first present, runs everything deferred on the calling thread
+void startup_run_deferred(struct Startup *startup);
+// per phase breakdown, grep for "[bench] startup"
+void startup_report(struct Startup *startup);
+void startup_destroy(struct Startup *startup);
+
+#endif
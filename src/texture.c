@@ -0,0 +1,764 @@
+#include "texture.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "clib/log.h"
+#include "timing.h"
+#include "vk_util.h"
+
+#define STAGING_ALIGNMENT 16 // multiple of every block size in formatInfos
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_INDEX_SIZE 24
+
+struct FormatInfo
+{
+    VkFormat format;
+    uint32_t blockBytes;
+    uint32_t blockWidth;
+    uint32_t blockHeight;
+};
+
+static const struct FormatInfo formatInfos[] = {
+    {VK_FORMAT_R8_UNORM, 1, 1, 1},
+    {VK_FORMAT_R8G8_UNORM, 2, 1, 1},
+    {VK_FORMAT_R8G8B8A8_UNORM, 4, 1, 1},
+    {VK_FORMAT_R8G8B8A8_SRGB, 4, 1, 1},
+    {VK_FORMAT_B8G8R8A8_UNORM, 4, 1, 1},
+    {VK_FORMAT_B8G8R8A8_SRGB, 4, 1, 1},
+    {VK_FORMAT_R16G16B16A16_SFLOAT, 8, 1, 1},
+    {VK_FORMAT_R32G32B32A32_SFLOAT, 16, 1, 1},
+    {VK_FORMAT_BC1_RGB_UNORM_BLOCK, 8, 4, 4},
+    {VK_FORMAT_BC1_RGB_SRGB_BLOCK, 8, 4, 4},
+    {VK_FORMAT_BC1_RGBA_UNORM_BLOCK, 8, 4, 4},
+    {VK_FORMAT_BC1_RGBA_SRGB_BLOCK, 8, 4, 4},
+    {VK_FORMAT_BC2_UNORM_BLOCK, 16, 4, 4},
+    {VK_FORMAT_BC2_SRGB_BLOCK, 16, 4, 4},
+    {VK_FORMAT_BC3_UNORM_BLOCK, 16, 4, 4},
+    {VK_FORMAT_BC3_SRGB_BLOCK, 16, 4, 4},
+    {VK_FORMAT_BC4_UNORM_BLOCK, 8, 4, 4},
+    {VK_FORMAT_BC4_SNORM_BLOCK, 8, 4, 4},
+    {VK_FORMAT_BC5_UNORM_BLOCK, 16, 4, 4},
+    {VK_FORMAT_BC5_SNORM_BLOCK, 16, 4, 4},
+    {VK_FORMAT_BC6H_UFLOAT_BLOCK, 16, 4, 4},
+    {VK_FORMAT_BC6H_SFLOAT_BLOCK, 16, 4, 4},
+    {VK_FORMAT_BC7_UNORM_BLOCK, 16, 4, 4},
+    {VK_FORMAT_BC7_SRGB_BLOCK, 16, 4, 4},
+};
+
+static const struct FormatInfo *format_info(VkFormat format)
+{
+    for (size_t i = 0; i < sizeof(formatInfos) / sizeof(formatInfos[0]); i++)
+    {
+        if (formatInfos[i].format == format)
+            return &formatInfos[i];
+    }
+    return NULL;
+}
+
+static uint32_t mip_count(uint32_t width, uint32_t height)
+{
+    uint32_t count = 1;
+    while ((width | height) >> count)
+        count++;
+    return count;
+}
+
+static VkExtent3D level_extent(const struct Texture *texture, uint32_t level)
+{
+    uint32_t w = texture->width >> level;
+    uint32_t h = texture->height >> level;
+    return (VkExtent3D){w ? w : 1, h ? h : 1, 1};
+}
+
+static size_t level_size(const struct FormatInfo *info, const struct Texture *texture, uint32_t level)
+{
+    VkExtent3D extent = level_extent(texture, level);
+    size_t blocksX = (extent.width + info->blockWidth - 1) / info->blockWidth;
+    size_t blocksY = (extent.height + info->blockHeight - 1) / info->blockHeight;
+    return blocksX * blocksY * info->blockBytes;
+}
+
+static VkFormatFeatureFlags format_features(struct TextureManager *manager, VkFormat format)
+{
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(manager->physicalDevice, format, &properties);
+    return properties.optimalTilingFeatures;
+}
+
+static int can_generate_mips(struct TextureManager *manager, VkFormat format)
+{
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                  VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (format_features(manager, format) & needed) == needed;
+}
+
+static void image_barrier(VkCommandBuffer buffer, VkImage image, uint32_t baseLevel, uint32_t levelCount,
+                          VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccess,
+                          VkAccessFlags dstAccess, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+{
+    VkImageMemoryBarrier barrier = {.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                                    .srcAccessMask = srcAccess,
+                                    .dstAccessMask = dstAccess,
+                                    .oldLayout = oldLayout,
+                                    .newLayout = newLayout,
+                                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                                    .image = image,
+                                    .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                                         .baseMipLevel = baseLevel,
+                                                         .levelCount = levelCount,
+                                                         .baseArrayLayer = 0,
+                                                         .layerCount = 1}};
+    vkCmdPipelineBarrier(buffer, srcStage, dstStage, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+int texture_manager_init(struct TextureManager *manager, VkPhysicalDevice physicalDevice, VkDevice device,
+                         const VkPhysicalDeviceMemoryProperties *memory, VkDeviceSize uploadBudget,
+                         VkDeviceSize vramBudget)
+{
+    memset(manager, 0, sizeof(*manager));
+    manager->physicalDevice = physicalDevice;
+    manager->device = device;
+    manager->memory = memory;
+    manager->uploadBudget = uploadBudget;
+    manager->vramBudget = vramBudget;
+    pool_init(&manager->texturePool, "textures", sizeof(struct Texture), 64);
+
+    // twice the budget so a level bigger than the budget can still go up on its own
+    manager->stagingSize = uploadBudget * 2;
+    VkMemoryPropertyFlags flags;
+    if (!create_buffer(device, memory, manager->stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &manager->staging,
+                       &manager->stagingMemory, &flags))
+    {
+        return 0;
+    }
+    manager->stagingCoherent = (flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) != 0;
+    vkMapMemory(device, manager->stagingMemory, 0, VK_WHOLE_SIZE, 0, (void **)&manager->stagingMapped);
+
+    VkSamplerCreateInfo samplerInfo = {.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+                                       .magFilter = VK_FILTER_LINEAR,
+                                       .minFilter = VK_FILTER_LINEAR,
+                                       .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+                                       .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                                       .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                                       .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+                                       .mipLodBias = 0.0f,
+                                       .anisotropyEnable = VK_FALSE,
+                                       .compareEnable = VK_FALSE,
+                                       .minLod = 0.0f,
+                                       .maxLod = VK_LOD_CLAMP_NONE,
+                                       .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
+                                       .unnormalizedCoordinates = VK_FALSE};
+    if (vkCreateSampler(device, &samplerInfo, host_vk_allocator(), &manager->sampler) != VK_SUCCESS)
+    {
+        loge("failed to create texture sampler!");
+        return 0;
+    }
+    manager->retired_capacity = 64;
+    manager->retired = malloc(sizeof(struct RetiredImage) * manager->retired_capacity);
+    if (!manager->retired)
+    {
+        loge("Not enough memory for the retired texture list");
+        return 0;
+    }
+    return 1;
+}
+
+static void free_texture_data(struct Texture *texture)
+{
+    if (texture->mapped)
+        munmap((void *)texture->data, texture->dataSize);
+    else
+        free((void *)texture->data);
+    texture->data = NULL;
+}
+
+void texture_manager_destroy(struct TextureManager *manager)
+{
+    VkDevice device = manager->device;
+    for (uint32_t i = 0; i < manager->retired_count; i++)
+    {
+        vkDestroyImageView(device, manager->retired[i].view, host_vk_allocator());
+        vkDestroyImage(device, manager->retired[i].image, host_vk_allocator());
+        vkFreeMemory(device, manager->retired[i].memory, host_vk_allocator());
+    }
+    for (uint32_t i = 0; i < manager->textures_count; i++)
+    {
+        struct Texture *texture = manager->textures[i];
+        if (texture->image != VK_NULL_HANDLE)
+        {
+            vkDestroyImageView(device, texture->view, host_vk_allocator());
+            vkDestroyImage(device, texture->image, host_vk_allocator());
+            vkFreeMemory(device, texture->memory, host_vk_allocator());
+        }
+        free_texture_data(texture);
+        pool_free(&manager->texturePool, texture);
+    }
+    free(manager->textures);
+    free(manager->retired);
+    vkDestroySampler(device, manager->sampler, host_vk_allocator());
+    vkUnmapMemory(device, manager->stagingMemory);
+    destroy_buffer(device, manager->staging, manager->stagingMemory);
+    pool_destroy(&manager->texturePool);
+    memset(manager, 0, sizeof(*manager));
+}
+
+static struct Texture *add_texture(struct TextureManager *manager)
+{
+    if (manager->textures_count == manager->textures_capacity)
+    {
+        uint32_t capacity = manager->textures_capacity ? manager->textures_capacity * 2 : 64;
+        struct Texture **textures = realloc(manager->textures, sizeof(struct Texture *) * capacity);
+        if (!textures)
+            return NULL;
+        manager->textures = textures;
+        manager->textures_capacity = capacity;
+    }
+    struct Texture *texture = pool_alloc(&manager->texturePool);
+    if (!texture)
+        return NULL;
+    memset(texture, 0, sizeof(*texture));
+    texture->blockedFrame = UINT64_MAX;
+    texture->id = manager->textures_count;
+    manager->textures[manager->textures_count++] = texture;
+    return texture;
+}
+
+// levels, residency and mip generation once format, size and source levels are known
+static void finish_texture(struct TextureManager *manager, struct Texture *texture, uint32_t sourceLevels)
+{
+    uint32_t fullChain = mip_count(texture->width, texture->height);
+    texture->generateMips = sourceLevels < fullChain && can_generate_mips(manager, texture->format);
+    texture->levels = texture->generateMips ? fullChain : sourceLevels;
+    texture->sourceLevels = texture->generateMips ? 1 : sourceLevels;
+    texture->residentBase = texture->levels;
+    if (sourceLevels < fullChain && !texture->generateMips)
+    {
+        logw("%s: %u of %u mip levels and format %i can't be blitted, using what is there", texture->name,
+             sourceLevels, fullChain, texture->format);
+    }
+}
+
+struct Texture *texture_load_ktx2(struct TextureManager *manager, const char *path)
+{
+    static const uint8_t identifier[12] = {0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        loge("Could not open texture %s", path);
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < KTX2_HEADER_SIZE)
+    {
+        loge("%s is not a ktx2 file", path);
+        close(fd);
+        return NULL;
+    }
+    size_t size = st.st_size;
+    const uint8_t *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        loge("Could not map %s", path);
+        return NULL;
+    }
+
+    uint32_t header[9]; // vkFormat, typeSize, width, height, depth, layers, faces, levels, supercompression
+    memcpy(header, data + 12, sizeof(header));
+    uint32_t levelCount = header[7] ? header[7] : 1;
+    const struct FormatInfo *info = format_info((VkFormat)header[0]);
+    const char *error = NULL;
+    if (memcmp(data, identifier, sizeof(identifier)) != 0)
+        error = "not a ktx2 file";
+    else if (!info)
+        error = "unsupported format";
+    else if (header[2] == 0 || header[3] == 0 || header[4] > 1 || header[5] > 1 || header[6] != 1)
+        error = "only single layer 2D textures are supported";
+    else if (header[8] != 0)
+        error = "supercompression is not supported";
+    else if (levelCount > TEXTURE_MAX_LEVELS || KTX2_HEADER_SIZE + levelCount * KTX2_LEVEL_INDEX_SIZE > size)
+        error = "bad level index";
+    else if (!(format_features(manager, info->format) & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT))
+        error = "format can't be sampled on this device";
+    if (error)
+    {
+        loge("%s: %s", path, error);
+        munmap((void *)data, size);
+        return NULL;
+    }
+
+    struct Texture *texture = add_texture(manager);
+    if (!texture)
+    {
+        munmap((void *)data, size);
+        return NULL;
+    }
+    texture->name = path;
+    texture->format = info->format;
+    texture->width = header[2];
+    texture->height = header[3];
+    texture->data = data;
+    texture->dataSize = size;
+    texture->mapped = 1;
+
+    uint32_t validLevels = 0;
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        uint64_t index[3]; // byteOffset, byteLength, uncompressedByteLength
+        memcpy(index, data + KTX2_HEADER_SIZE + level * KTX2_LEVEL_INDEX_SIZE, sizeof(index));
+        size_t expected = level_size(info, texture, level);
+        if (index[0] > size || index[1] > size - index[0] || index[1] < expected)
+            break;
+        texture->levelOffsets[level] = index[0];
+        texture->levelSizes[level] = expected;
+        validLevels++;
+    }
+    if (validLevels == 0)
+    {
+        loge("%s: level data out of bounds", path);
+        texture->failed = 1;
+        return texture;
+    }
+    // ktx2 levelCount 0 asks for generated mips
+    finish_texture(manager, texture, header[7] ? validLevels : 1);
+    logi("Texture %s: %ux%u format %i, %u levels%s", path, texture->width, texture->height, texture->format,
+         texture->levels, texture->generateMips ? " (generated)" : "");
+    return texture;
+}
+
+struct Texture *texture_create(struct TextureManager *manager, const char *name, VkFormat format, uint32_t width,
+                               uint32_t height, const void *pixels, size_t size)
+{
+    const struct FormatInfo *info = format_info(format);
+    if (!info || width == 0 || height == 0)
+    {
+        loge("%s: unsupported texture", name);
+        return NULL;
+    }
+    struct Texture *texture = add_texture(manager);
+    if (!texture)
+        return NULL;
+    texture->name = name;
+    texture->format = format;
+    texture->width = width;
+    texture->height = height;
+    size_t expected = level_size(info, texture, 0);
+    uint8_t *copy = malloc(expected);
+    if (!copy || size < expected)
+    {
+        loge("%s: %zu bytes of pixels, expected %zu", name, size, expected);
+        free(copy);
+        texture->failed = 1;
+        return texture;
+    }
+    memcpy(copy, pixels, expected);
+    texture->data = copy;
+    texture->dataSize = expected;
+    texture->levelSizes[0] = expected;
+    finish_texture(manager, texture, 1);
+    return texture;
+}
+
+void texture_touch(struct TextureManager *manager, struct Texture *texture)
+{
+    texture->lastUsedFrame = manager->frame;
+}
+
+// room for one more retired image, checked before anything is created so retire itself can't fail
+static int reserve_retired(struct TextureManager *manager)
+{
+    if (manager->retired_count < manager->retired_capacity)
+        return 1;
+    uint32_t capacity = manager->retired_capacity * 2;
+    struct RetiredImage *retired = realloc(manager->retired, sizeof(struct RetiredImage) * capacity);
+    if (!retired)
+        return 0;
+    manager->retired = retired;
+    manager->retired_capacity = capacity;
+    return 1;
+}
+
+static void retire(struct TextureManager *manager, struct Texture *texture)
+{
+    if (texture->image == VK_NULL_HANDLE)
+        return;
+    manager->retired[manager->retired_count++] = (struct RetiredImage){
+        .image = texture->image, .view = texture->view, .memory = texture->memory, .frame = manager->frame};
+    manager->residentBytes -= texture->memorySize;
+    texture->image = VK_NULL_HANDLE;
+    texture->view = VK_NULL_HANDLE;
+    texture->memory = VK_NULL_HANDLE;
+    texture->memorySize = 0;
+}
+
+static void free_retired(struct TextureManager *manager)
+{
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < manager->retired_count; i++)
+    {
+        struct RetiredImage *r = &manager->retired[i];
+        if (r->frame < manager->frame)
+        {
+            vkDestroyImageView(manager->device, r->view, host_vk_allocator());
+            vkDestroyImage(manager->device, r->image, host_vk_allocator());
+            vkFreeMemory(manager->device, r->memory, host_vk_allocator());
+        }
+        else
+        {
+            manager->retired[kept++] = *r;
+        }
+    }
+    manager->retired_count = kept;
+}
+
+// image for the levels [base, levels), not bound to memory yet
+static VkImage create_image(struct TextureManager *manager, const struct Texture *texture, uint32_t base,
+                            VkMemoryRequirements *requirements)
+{
+    VkImageCreateInfo imageInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                                   .imageType = VK_IMAGE_TYPE_2D,
+                                   .format = texture->format,
+                                   .extent = level_extent(texture, base),
+                                   .mipLevels = texture->levels - base,
+                                   .arrayLayers = 1,
+                                   .samples = VK_SAMPLE_COUNT_1_BIT,
+                                   .tiling = VK_IMAGE_TILING_OPTIMAL,
+                                   .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                                            VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                                   .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                                   .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+    VkImage image = VK_NULL_HANDLE;
+    if (vkCreateImage(manager->device, &imageInfo, host_vk_allocator(), &image) != VK_SUCCESS)
+    {
+        loge("failed to create image for %s", texture->name);
+        return VK_NULL_HANDLE;
+    }
+    manager->imagesCreated++;
+    vkGetImageMemoryRequirements(manager->device, image, requirements);
+    return image;
+}
+
+static int bind_image_memory(struct TextureManager *manager, VkImage image, const VkMemoryRequirements *requirements,
+                             VkDeviceMemory *memory)
+{
+    uint32_t type = find_memory_type(manager->memory, requirements->memoryTypeBits,
+                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    if (type == UINT32_MAX)
+        return 0;
+    VkMemoryAllocateInfo allocInfo = {.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                                      .allocationSize = requirements->size,
+                                      .memoryTypeIndex = type};
+    if (vkAllocateMemory(manager->device, &allocInfo, host_vk_allocator(), memory) != VK_SUCCESS)
+        return 0;
+    vkBindImageMemory(manager->device, image, *memory, 0);
+    return 1;
+}
+
+// Moves the texture into `image` which holds [base, levels). Levels that are
+// resident in both are copied over, the old image is retired. Leaves the new
+// image in TRANSFER_DST_OPTIMAL for the caller to fill the rest.
+static void replace_image(struct TextureManager *manager, VkCommandBuffer buffer, struct Texture *texture,
+                          uint32_t base, VkImage image, VkDeviceMemory memory, VkDeviceSize memorySize)
+{
+    uint32_t levelCount = texture->levels - base;
+    image_barrier(buffer, image, 0, levelCount, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 0,
+                  VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    if (texture->image != VK_NULL_HANDLE && !texture->generateMips)
+    {
+        uint32_t oldBase = texture->residentBase;
+        uint32_t first = oldBase > base ? oldBase : base;
+        // the old image may have been written earlier in this command buffer
+        image_barrier(buffer, texture->image, first - oldBase, texture->levels - first,
+                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                      VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT);
+        VkImageCopy regions[TEXTURE_MAX_LEVELS];
+        uint32_t regions_count = 0;
+        for (uint32_t level = first; level < texture->levels; level++)
+        {
+            regions[regions_count++] = (VkImageCopy){
+                .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - oldBase, 0, 1},
+                .srcOffset = {0, 0, 0},
+                .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - base, 0, 1},
+                .dstOffset = {0, 0, 0},
+                .extent = level_extent(texture, level),
+            };
+        }
+        vkCmdCopyImage(buffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, regions_count, regions);
+        // the retired view lives until the next frame and descriptors still pointing at it expect this layout
+        image_barrier(buffer, texture->image, first - oldBase, texture->levels - first,
+                      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                      VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
+    retire(manager, texture);
+
+    VkImageViewCreateInfo viewInfo = {.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                                      .image = image,
+                                      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                                      .format = texture->format,
+                                      .components = {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY,
+                                                     VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY},
+                                      .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                                                           .baseMipLevel = 0,
+                                                           .levelCount = levelCount,
+                                                           .baseArrayLayer = 0,
+                                                           .layerCount = 1}};
+    if (vkCreateImageView(manager->device, &viewInfo, host_vk_allocator(), &texture->view) != VK_SUCCESS)
+    {
+        loge("failed to create image view for %s", texture->name);
+    }
+    texture->image = image;
+    texture->memory = memory;
+    texture->memorySize = memorySize;
+    texture->residentBase = base;
+    texture->viewGeneration++;
+    manager->residentBytes += memorySize;
+}
+
+static void upload_level(struct TextureManager *manager, VkCommandBuffer buffer, struct Texture *texture,
+                         uint32_t level)
+{
+    VkDeviceSize offset = (manager->stagingUsed + STAGING_ALIGNMENT - 1) & ~(VkDeviceSize)(STAGING_ALIGNMENT - 1);
+    size_t size = texture->levelSizes[level];
+    memcpy(manager->stagingMapped + offset, texture->data + texture->levelOffsets[level], size);
+    manager->stagingUsed = offset + size;
+
+    VkBufferImageCopy region = {.bufferOffset = offset,
+                                .bufferRowLength = 0,
+                                .bufferImageHeight = 0,
+                                .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - texture->residentBase, 0, 1},
+                                .imageOffset = {0, 0, 0},
+                                .imageExtent = level_extent(texture, level)};
+    vkCmdCopyBufferToImage(buffer, manager->staging, texture->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                           &region);
+    manager->uploadedBytes += size;
+    manager->uploads++;
+
+    // let the kernel page in the next finer level while this one is on its way
+    if (texture->mapped && level > 0)
+    {
+        long page = sysconf(_SC_PAGESIZE);
+        size_t start = texture->levelOffsets[level - 1] & ~(size_t)(page - 1);
+        size_t end = texture->levelOffsets[level - 1] + texture->levelSizes[level - 1];
+        madvise((void *)(texture->data + start), end - start, MADV_WILLNEED);
+    }
+}
+
+static void generate_mips(VkCommandBuffer buffer, struct Texture *texture)
+{
+    for (uint32_t level = 1; level < texture->levels; level++)
+    {
+        image_barrier(buffer, texture->image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        VkExtent3D src = level_extent(texture, level - 1);
+        VkExtent3D dst = level_extent(texture, level);
+        VkImageBlit blit = {
+            .srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1},
+            .srcOffsets = {{0, 0, 0}, {(int32_t)src.width, (int32_t)src.height, 1}},
+            .dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1},
+            .dstOffsets = {{0, 0, 0}, {(int32_t)dst.width, (int32_t)dst.height, 1}},
+        };
+        vkCmdBlitImage(buffer, texture->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture->image,
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+    }
+    // every level but the last one ended up as a blit source
+    if (texture->levels > 1)
+    {
+        image_barrier(buffer, texture->image, 0, texture->levels - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+    }
+    image_barrier(buffer, texture->image, texture->levels - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+                  VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
+static void finish_transfer(VkCommandBuffer buffer, struct Texture *texture)
+{
+    image_barrier(buffer, texture->image, 0, texture->levels - texture->residentBase,
+                  VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                  VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                  VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+}
+
+// drops the finest resident level, the texture keeps at least its coarsest one
+static int evict_level(struct TextureManager *manager, VkCommandBuffer buffer, struct Texture *texture)
+{
+    if (texture->image == VK_NULL_HANDLE || texture->residentBase + 1 >= texture->levels ||
+        !reserve_retired(manager))
+        return 0;
+    VkMemoryRequirements requirements;
+    VkImage image = create_image(manager, texture, texture->residentBase + 1, &requirements);
+    VkDeviceMemory memory;
+    if (image == VK_NULL_HANDLE)
+        return 0;
+    if (!bind_image_memory(manager, image, &requirements, &memory))
+    {
+        vkDestroyImage(manager->device, image, host_vk_allocator());
+        return 0;
+    }
+    // generated chains copy like any other, they only can't be re-uploaded level by level
+    int generated = texture->generateMips;
+    texture->generateMips = 0;
+    replace_image(manager, buffer, texture, texture->residentBase + 1, image, memory, requirements.size);
+    texture->generateMips = generated;
+    finish_transfer(buffer, texture);
+    manager->evictions++;
+    return 1;
+}
+
+// least recently used texture than `than` that still has a level to give up
+static struct Texture *eviction_victim(struct TextureManager *manager, const struct Texture *than)
+{
+    struct Texture *victim = NULL;
+    for (uint32_t i = 0; i < manager->textures_count; i++)
+    {
+        struct Texture *t = manager->textures[i];
+        if (t == than || t->image == VK_NULL_HANDLE || t->residentBase + 1 >= t->levels)
+            continue;
+        if (than && t->lastUsedFrame >= than->lastUsedFrame)
+            continue;
+        if (!victim || t->lastUsedFrame < victim->lastUsedFrame ||
+            (t->lastUsedFrame == victim->lastUsedFrame && t->memorySize > victim->memorySize))
+        {
+            victim = t;
+        }
+    }
+    return victim;
+}
+
+// recently used textures first, among those the blurriest
+static struct Texture *stream_candidate(struct TextureManager *manager)
+{
+    struct Texture *best = NULL;
+    for (uint32_t i = 0; i < manager->textures_count; i++)
+    {
+        struct Texture *t = manager->textures[i];
+        if (t->failed || t->residentBase == 0 || t->blockedFrame == manager->frame)
+            continue;
+        if (!best || t->lastUsedFrame > best->lastUsedFrame ||
+            (t->lastUsedFrame == best->lastUsedFrame && t->residentBase > best->residentBase))
+        {
+            best = t;
+        }
+    }
+    return best;
+}
+
+int texture_stream_update(struct TextureManager *manager, VkCommandBuffer buffer, uint64_t frame)
+{
+    double start = time_ms();
+    uint64_t imagesCreated = manager->imagesCreated;
+    manager->frame = frame;
+    free_retired(manager);
+    manager->stagingUsed = 0;
+
+    // the budget may have shrunk or the last frame may have overshot it
+    struct Texture *victim;
+    while (manager->residentBytes > manager->vramBudget && (victim = eviction_victim(manager, NULL)))
+    {
+        if (!evict_level(manager, buffer, victim))
+            break;
+    }
+
+    struct Texture *texture;
+    while ((texture = stream_candidate(manager)))
+    {
+        // generated chains need level 0 and build everything else from it
+        uint32_t base = texture->generateMips ? 0 : texture->residentBase - 1;
+        uint32_t sourceLevel = texture->generateMips ? 0 : base;
+        size_t size = texture->levelSizes[sourceLevel];
+        VkDeviceSize offset =
+            (manager->stagingUsed + STAGING_ALIGNMENT - 1) & ~(VkDeviceSize)(STAGING_ALIGNMENT - 1);
+        // a level that doesn't fit any more waits for the next frame, smaller ones behind it may still fit
+        if (manager->stagingUsed > 0 &&
+            (manager->stagingUsed + size > manager->uploadBudget || offset + size > manager->stagingSize))
+        {
+            texture->blockedFrame = frame;
+            continue;
+        }
+        if (offset + size > manager->stagingSize)
+        {
+            loge("%s: level %u is %zu bytes, more than the staging buffer holds", texture->name, sourceLevel, size);
+            texture->failed = 1;
+            continue;
+        }
+
+        VkMemoryRequirements requirements;
+        VkImage image = create_image(manager, texture, base, &requirements);
+        if (image == VK_NULL_HANDLE)
+        {
+            texture->failed = 1;
+            continue;
+        }
+        // make room by taking levels off textures that were used less recently
+        while (manager->residentBytes - texture->memorySize + requirements.size > manager->vramBudget &&
+               (victim = eviction_victim(manager, texture)))
+        {
+            if (!evict_level(manager, buffer, victim))
+                break;
+        }
+        VkDeviceMemory memory;
+        if (manager->residentBytes - texture->memorySize + requirements.size > manager->vramBudget ||
+            !reserve_retired(manager) || !bind_image_memory(manager, image, &requirements, &memory))
+        {
+            vkDestroyImage(manager->device, image, host_vk_allocator());
+            texture->blockedFrame = frame;
+            continue;
+        }
+
+        replace_image(manager, buffer, texture, base, image, memory, requirements.size);
+        upload_level(manager, buffer, texture, sourceLevel);
+        if (texture->generateMips)
+        {
+            generate_mips(buffer, texture);
+            manager->generatedMipChains++;
+        }
+        else
+        {
+            finish_transfer(buffer, texture);
+        }
+    }
+
+    if (!manager->stagingCoherent && manager->stagingUsed > 0)
+    {
+        VkMappedMemoryRange range = {.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+                                     .memory = manager->stagingMemory,
+                                     .offset = 0,
+                                     .size = VK_WHOLE_SIZE};
+        vkFlushMappedMemoryRanges(manager->device, 1, &range);
+    }
+    double ms = time_ms() - start;
+    if (ms > manager->maxUpdateMs)
+        manager->maxUpdateMs = ms;
+    return manager->imagesCreated != imagesCreated;
+}
+
+void texture_report(const struct TextureManager *manager)
+{
+    uint32_t full = 0;
+    for (uint32_t i = 0; i < manager->textures_count; i++)
+    {
+        if (manager->textures[i]->residentBase == 0)
+            full++;
+    }
+    logi("[bench] textures count=%u full_res=%u resident_mib=%.2f uploaded_mib=%.2f uploads=%llu "
+         "generated=%llu evictions=%llu max_update_ms=%.3f",
+         manager->textures_count, full, (double)manager->residentBytes / (1024.0 * 1024.0),
+         (double)manager->uploadedBytes / (1024.0 * 1024.0), (unsigned long long)manager->uploads,
+         (unsigned long long)manager->generatedMipChains, (unsigned long long)manager->evictions,
+         manager->maxUpdateMs);
+}
@@ -0,0 +1,115 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+#include "host_memory.h"
+
+#define TEXTURE_MAX_LEVELS 16
+
+// A texture owns an image holding only the levels [residentBase, levels).
+// Streaming a finer level in or evicting the finest one out swaps the image
+// for a bigger/smaller one and copies the other levels over on the GPU, the
+// old image is destroyed once the frame that used it last has finished.
+struct Texture
+{
+    const char *name;
+    uint32_t id; // index in TextureManager.textures
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;       // full mip chain of the image
+    uint32_t sourceLevels; // levels present in the source data
+    int generateMips;      // only level 0 is uploaded, the rest is blitted on the GPU
+
+    // source, mmapped ktx2 file or a private copy
+    const uint8_t *data;
+    size_t dataSize;
+    int mapped;
+    size_t levelOffsets[TEXTURE_MAX_LEVELS];
+    size_t levelSizes[TEXTURE_MAX_LEVELS];
+
+    uint32_t residentBase; // == levels while nothing is resident
+    VkImage image;
+    VkImageView view;        // covers every resident level, VK_NULL_HANDLE if none
+    uint32_t viewGeneration; // bumped whenever view changes
+    VkDeviceMemory memory;
+    VkDeviceSize memorySize;
+    uint64_t lastUsedFrame;
+    uint64_t blockedFrame; // could not stream in this frame, out of budget
+    int failed;
+};
+
+struct RetiredImage
+{
+    VkImage image;
+    VkImageView view;
+    VkDeviceMemory memory;
+    uint64_t frame;
+};
+
+struct TextureManager
+{
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+    const VkPhysicalDeviceMemoryProperties *memory;
+    VkSampler sampler;
+
+    struct HostPool texturePool;
+    struct Texture **textures;
+    uint32_t textures_count;
+    uint32_t textures_capacity;
+
+    // persistently mapped, linearly filled every frame
+    VkBuffer staging;
+    VkDeviceMemory stagingMemory;
+    uint8_t *stagingMapped;
+    VkDeviceSize stagingSize;
+    VkDeviceSize stagingUsed;
+    int stagingCoherent;
+
+    VkDeviceSize uploadBudget; // bytes per frame
+    VkDeviceSize vramBudget;   // bytes of texture memory
+    VkDeviceSize residentBytes;
+
+    struct RetiredImage *retired;
+    uint32_t retired_count;
+    uint32_t retired_capacity;
+    uint64_t frame;
+
+    uint64_t uploadedBytes;
+    uint64_t uploads;
+    uint64_t evictions;
+    uint64_t generatedMipChains;
+    uint64_t imagesCreated;
+    double maxUpdateMs;
+};
+
+int texture_manager_init(struct TextureManager *manager, VkPhysicalDevice physicalDevice, VkDevice device,
+                         const VkPhysicalDeviceMemoryProperties *memory, VkDeviceSize uploadBudget,
+                         VkDeviceSize vramBudget);
+// device has to be idle
+void texture_manager_destroy(struct TextureManager *manager);
+
+// maps a KTX2 file (2D, one layer, no supercompression). Nothing is uploaded
+// until texture_stream_update streams levels in, coarsest first.
+struct Texture *texture_load_ktx2(struct TextureManager *manager, const char *path);
+// tightly packed pixels of `format`, copied. Mips are generated if the format allows blitting.
+struct Texture *texture_create(struct TextureManager *manager, const char *name, VkFormat format, uint32_t width,
+                               uint32_t height, const void *pixels, size_t size);
+
+// marks the texture as used this frame, streaming and eviction follow usage
+void texture_touch(struct TextureManager *manager, struct Texture *texture);
+
+// Records uploads (within the upload budget), mip generation and evictions
+// (to stay in the vram budget) into `buffer`, outside of a render pass. Call
+// once per frame after the previous frame's fence was waited on. Leaves every
+// resident image in SHADER_READ_ONLY_OPTIMAL. Returns 1 if it created images,
+// which allocates host memory through host_vk_allocator.
+int texture_stream_update(struct TextureManager *manager, VkCommandBuffer buffer, uint64_t frame);
+
+void texture_report(const struct TextureManager *manager);
+
+#endif
@@ -0,0 +1,24 @@
+#include "timing.h"
+
+#include "clib/log.h"
+
+void frame_stats_add(struct FrameStats *stats, double frame_ms)
+{
+    if (stats->count == 0 || frame_ms < stats->min_ms)
+        stats->min_ms = frame_ms;
+    if (stats->count == 0 || frame_ms > stats->max_ms)
+        stats->max_ms = frame_ms;
+    stats->total_ms += frame_ms;
+    stats->count++;
+}
+
+double frame_stats_avg(const struct FrameStats *stats)
+{
+    return stats->count ? stats->total_ms / (double)stats->count : 0.0;
+}
+
+void frame_stats_report(const char *label, const struct FrameStats *stats)
+{
+    logi("[bench] config=%s %s frames=%llu avg_ms=%.3f min_ms=%.3f max_ms=%.3f", BUILD_CONFIG, label,
+         (unsigned long long)stats->count, frame_stats_avg(stats), stats->min_ms, stats->max_ms);
+}
@@ -0,0 +1,32 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdint.h>
+#include <time.h>
+
+#ifndef BUILD_CONFIG
+#define BUILD_CONFIG "Unknown"
+#endif
+
+// monotonic time in milliseconds
+static inline double time_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+struct FrameStats
+{
+    uint64_t count;
+    double total_ms;
+    double min_ms;
+    double max_ms;
+};
+
+void frame_stats_add(struct FrameStats *stats, double frame_ms);
+double frame_stats_avg(const struct FrameStats *stats);
+// one machine readable line, grep for "[bench]"
+void frame_stats_report(const char *label, const struct FrameStats *stats);
+
+#endif
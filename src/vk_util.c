@@ -0,0 +1,146 @@
+#include "vk_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "clib/log.h"
+#include "host_memory.h"
+
+code read_shader(const char *filename)
+{
+    FILE *file = fopen(filename, "rb");
+    if (!file)
+    {
+        loge("Could not open file %s\n", filename);
+        fflush(stdout);
+        return (code){.size = 0, .ptr = NULL};
+    }
+
+    // Move the file pointer to the end of the file to determine file size
+    fseek(file, 0, SEEK_END);
+    size_t fileSize = ftell(file);
+    rewind(file); // Move file pointer back to the beginning
+
+    if (fileSize % sizeof(uint32_t) != 0)
+    {
+        loge("Invalid SPIR-V file size");
+        fclose(file);
+        return (code){.size = 0, .ptr = NULL};
+    }
+
+    // Allocate memory for the file content
+    uint32_t *content = (uint32_t *)malloc(fileSize);
+    if (!content)
+    {
+        loge("Memory allocation failed\n");
+        fclose(file);
+        return (code){.size = 0, .ptr = NULL};
+    }
+    size_t read_count = fread(content, 1, fileSize, file);
+    // Close the file and return the content
+    fclose(file);
+    if (read_count != fileSize)
+    {
+        loge("Failed to read full shader file");
+        exit(1);
+    }
+
+    return (code){.ptr = (uint32_t *)content, .size = fileSize};
+}
+
+VkShaderModule createShaderModule(VkDevice device, code code)
+{
+    VkShaderModuleCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO, .codeSize = code.size, .pCode = code.ptr};
+    VkShaderModule shaderModule;
+    if (vkCreateShaderModule(device, &createInfo, host_vk_allocator(), &shaderModule) != VK_SUCCESS)
+    {
+        loge("failed to create shader module!");
+        exit(1);
+    }
+    return shaderModule;
+}
+
+VkPipeline createComputePipeline(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout,
+                                 code shader)
+{
+    VkShaderModule module = createShaderModule(device, shader);
+    VkComputePipelineCreateInfo pipelineInfo = {.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                                                .stage = {.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                                                          .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                                                          .module = module,
+                                                          .pName = "main"},
+                                                .layout = layout,
+                                                .basePipelineHandle = VK_NULL_HANDLE};
+    VkPipeline computePipeline;
+    if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, host_vk_allocator(), &computePipeline) !=
+        VK_SUCCESS)
+    {
+        loge("failed to create compute pipeline!");
+        computePipeline = VK_NULL_HANDLE;
+    }
+    vkDestroyShaderModule(device, module, host_vk_allocator());
+    return computePipeline;
+}
+
+uint32_t find_memory_type(const VkPhysicalDeviceMemoryProperties *memory, uint32_t typeBits,
+                          VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred)
+{
+    uint32_t fallback = UINT32_MAX;
+    for (uint32_t i = 0; i < memory->memoryTypeCount; i++)
+    {
+        VkMemoryPropertyFlags flags = memory->memoryTypes[i].propertyFlags;
+        if (!(typeBits & (1u << i)) || (flags & required) != required)
+            continue;
+        if ((flags & preferred) == preferred)
+            return i;
+        if (fallback == UINT32_MAX)
+            fallback = i;
+    }
+    return fallback;
+}
+
+int create_buffer(VkDevice device, const VkPhysicalDeviceMemoryProperties *memory, VkDeviceSize size,
+                  VkBufferUsageFlags usage, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+                  VkBuffer *buffer, VkDeviceMemory *bufferMemory, VkMemoryPropertyFlags *flags)
+{
+    VkBufferCreateInfo bufferInfo = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                                     .size = size,
+                                     .usage = usage,
+                                     .sharingMode = VK_SHARING_MODE_EXCLUSIVE};
+    if (vkCreateBuffer(device, &bufferInfo, host_vk_allocator(), buffer) != VK_SUCCESS)
+    {
+        loge("failed to create buffer!");
+        *buffer = VK_NULL_HANDLE;
+        return 0;
+    }
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, *buffer, &requirements);
+    uint32_t type = find_memory_type(memory, requirements.memoryTypeBits, required, preferred);
+    if (type == UINT32_MAX)
+    {
+        loge("no memory type for buffer of %llu bytes", (unsigned long long)size);
+        vkDestroyBuffer(device, *buffer, host_vk_allocator());
+        *buffer = VK_NULL_HANDLE;
+        return 0;
+    }
+    VkMemoryAllocateInfo allocInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, .allocationSize = requirements.size, .memoryTypeIndex = type};
+    if (vkAllocateMemory(device, &allocInfo, host_vk_allocator(), bufferMemory) != VK_SUCCESS)
+    {
+        loge("failed to allocate %llu bytes of buffer memory", (unsigned long long)requirements.size);
+        vkDestroyBuffer(device, *buffer, host_vk_allocator());
+        *buffer = VK_NULL_HANDLE;
+        return 0;
+    }
+    vkBindBufferMemory(device, *buffer, *bufferMemory, 0);
+    if (flags)
+        *flags = memory->memoryTypes[type].propertyFlags;
+    return 1;
+}
+
+void destroy_buffer(VkDevice device, VkBuffer buffer, VkDeviceMemory bufferMemory)
+{
+    vkDestroyBuffer(device, buffer, host_vk_allocator());
+    vkFreeMemory(device, bufferMemory, host_vk_allocator());
+}
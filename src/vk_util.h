@@ -0,0 +1,33 @@
+#ifndef VK_UTIL_H
+#define VK_UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// SPIR-V words, malloc'd by read_shader
+typedef struct
+{
+    uint32_t *ptr;
+    size_t size;
+} code;
+
+code read_shader(const char *filename);
+VkShaderModule createShaderModule(VkDevice device, code code);
+// mirrors createGraphicsPipeline for a single compute stage, the layout stays owned by the caller
+VkPipeline createComputePipeline(VkDevice device, VkPipelineCache pipelineCache, VkPipelineLayout layout,
+                                 code shader);
+
+// index of a memory type allowed by typeBits with all `required` flags, one that
+// also has the `preferred` flags wins. UINT32_MAX if there is none.
+uint32_t find_memory_type(const VkPhysicalDeviceMemoryProperties *memory, uint32_t typeBits,
+                          VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred);
+
+// buffer with its own dedicated allocation, `flags` receives the property flags
+// of the memory type that was picked. Returns 0 on failure.
+int create_buffer(VkDevice device, const VkPhysicalDeviceMemoryProperties *memory, VkDeviceSize size,
+                  VkBufferUsageFlags usage, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+                  VkBuffer *buffer, VkDeviceMemory *bufferMemory, VkMemoryPropertyFlags *flags);
+void destroy_buffer(VkDevice device, VkBuffer buffer, VkDeviceMemory bufferMemory);
+
+#endif